@@ -0,0 +1,33 @@
+#version 450
+
+layout (location = 0) in vec2 vLocal;
+layout (location = 1) flat in vec2 vHalfSize;
+layout (location = 2) flat in vec4 vRadii; // topLeft, topRight, bottomLeft, bottomRight
+layout (location = 3) flat in vec4 vCol;
+layout (location = 4) flat in vec4 vBorderCol;
+layout (location = 5) flat in float vBorderWidth;
+
+layout (location = 0) out vec4 outCol;
+
+// VkBackend::PipelineDesc::edgeAA. Without it, the edge is a hard step at the exact shape boundary.
+layout (constant_id = 0) const bool EDGE_AA = true;
+
+// Signed distance to a rounded box centered at the origin, one radius per quadrant.
+// Positive y is the top side, matching RenderList::BorderRadius.
+float roundedBox(vec2 p, vec2 halfSize, vec4 radii) {
+  float r = p.x > 0.0 ? (p.y > 0.0 ? radii.y : radii.w) : (p.y > 0.0 ? radii.x : radii.z);
+  vec2 q = abs(p) - halfSize + r;
+  return min(max(q.x, q.y), 0.0) + length(max(q, 0.0)) - r;
+}
+
+void main() {
+  float d = roundedBox(vLocal, vHalfSize, vRadii);
+  // A width close to zero turns the ramps below into steps.
+  float aa = EDGE_AA ? max(fwidth(d), 1e-4) : 1e-4;
+
+  float coverage = clamp(0.5 - d / aa, 0.0, 1.0);
+  float fill = vBorderWidth > 0.0 ? clamp(0.5 - (d + vBorderWidth) / aa, 0.0, 1.0) : 1.0;
+
+  vec4 col = mix(vBorderCol, vCol, fill);
+  outCol = vec4(col.rgb, col.a * coverage);
+}
@@ -0,0 +1,63 @@
+#version 450
+
+// Per instance, see VkBackend::RectInstance.
+layout (location = 0) in vec4 iBounds;
+layout (location = 1) in vec4 iRadii;
+layout (location = 2) in vec4 iCol;
+layout (location = 3) in vec4 iBorderCol;
+layout (location = 4) in float iBorderWidth;
+
+layout (location = 0) out vec2 outLocal;
+layout (location = 1) flat out vec2 outHalfSize;
+layout (location = 2) flat out vec4 outRadii;
+layout (location = 3) flat out vec4 outCol;
+layout (location = 4) flat out vec4 outBorderCol;
+layout (location = 5) flat out float outBorderWidth;
+
+// Both passes have to compute the same depth for an instance, see VkBackend::PipelineDesc::opaquePass.
+invariant gl_Position;
+
+layout (push_constant) uniform constants {
+  mat4 model;
+  mat4 view;
+  mat4 proj;
+  // VKUIX::DrawBatcher::depthStep. Every instance is this much nearer than the one before, the model matrix holds the base.
+  float depthStep;
+} Matrix;
+
+// Two triangles with the same winding as RenderList::rect.
+const vec2 CORNERS[6] = vec2[](
+  vec2(0.0, 0.0), vec2(1.0, 0.0), vec2(1.0, 1.0),
+  vec2(0.0, 0.0), vec2(1.0, 1.0), vec2(0.0, 1.0)
+);
+
+// Quad grows by this many units on every side so the antialiased edge is not cut off.
+const float AA_PAD = 1.0;
+
+// VkBackend::PipelineDesc::opaquePass. The quad shrinks to the inner rect no corner or antialiased edge reaches,
+// which is fully covered. The translucent pass draws the rest of the shape, empty quads draw nothing.
+layout (constant_id = 0) const bool OPAQUE_PASS = false;
+
+
+void main() {
+  vec2 corner = CORNERS[gl_VertexIndex];
+  vec2 halfSize = iBounds.zw * 0.5;
+  vec2 center = iBounds.xy + halfSize;
+
+  vec4 radii = min(iRadii, vec4(min(halfSize.x, halfSize.y)));
+
+  vec2 extent = halfSize + AA_PAD;
+  if (OPAQUE_PASS) {
+    float inset = max(max(radii.x, radii.y), max(radii.z, radii.w)) + AA_PAD;
+    extent = max(halfSize - inset, vec2(0.0));
+  }
+  vec2 local = (corner * 2.0 - 1.0) * extent;
+  gl_Position = Matrix.proj * Matrix.model * vec4(center + local, float(gl_InstanceIndex) * Matrix.depthStep, 1.0f);
+
+  outLocal = local;
+  outHalfSize = halfSize;
+  outRadii = radii;
+  outCol = iCol;
+  outBorderCol = iBorderCol;
+  outBorderWidth = iBorderWidth;
+}
@@ -1,4 +1,8 @@
 @echo off
 C:/VulkanSDK/1.3.280.0/Bin/glslc.exe default.vert --target-env=vulkan1.2 -o default.vert.spv
 C:/VulkanSDK/1.3.280.0/Bin/glslc.exe default.frag --target-env=vulkan1.2 -o default.frag.spv
-echo Compiled Shaders
\ No newline at end of file
+C:/VulkanSDK/1.3.280.0/Bin/glslc.exe roundrect.vert --target-env=vulkan1.2 -o roundrect.vert.spv
+C:/VulkanSDK/1.3.280.0/Bin/glslc.exe roundrect.frag --target-env=vulkan1.2 -o roundrect.frag.spv
+C:/VulkanSDK/1.3.280.0/Bin/glslc.exe textured.vert --target-env=vulkan1.2 -o textured.vert.spv
+C:/VulkanSDK/1.3.280.0/Bin/glslc.exe textured.frag --target-env=vulkan1.2 -o textured.frag.spv
+echo Compiled Shaders
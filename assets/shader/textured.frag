@@ -0,0 +1,17 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout (location = 0) in vec2 vUv;
+layout (location = 1) flat in vec4 vCol;
+layout (location = 2) flat in uint vTexture;
+
+layout (location = 0) out vec4 outCol;
+
+// Bindless texture table, see VKUIX::TextureTable. The glyph atlas swizzles its R8 coverage into alpha,
+// so text and images share this shader.
+layout (set = 1, binding = 0) uniform sampler2D textures[];
+
+void main() {
+  // One draw mixes instances of different textures, so the index is not uniform.
+  outCol = vCol * texture(textures[nonuniformEXT(vTexture)], vUv);
+}
@@ -0,0 +1,32 @@
+#version 450
+
+// Per instance, see VkBackend::TexturedInstance.
+layout (location = 0) in vec4 iBounds;
+layout (location = 1) in vec4 iUv;
+layout (location = 2) in vec4 iCol;
+layout (location = 3) in uint iTexture;
+
+layout (location = 0) out vec2 outUv;
+layout (location = 1) flat out vec4 outCol;
+layout (location = 2) flat out uint outTexture;
+
+layout (push_constant) uniform constants {
+  mat4 model;
+  mat4 view;
+  mat4 proj;
+} Matrix;
+
+// Two triangles with the same winding as RenderList::rect.
+const vec2 CORNERS[6] = vec2[](
+  vec2(0.0, 0.0), vec2(1.0, 0.0), vec2(1.0, 1.0),
+  vec2(0.0, 0.0), vec2(1.0, 1.0), vec2(0.0, 1.0)
+);
+
+void main() {
+  vec2 corner = CORNERS[gl_VertexIndex];
+  gl_Position = Matrix.proj * Matrix.model * vec4(iBounds.xy + corner * iBounds.zw, 0.0f, 1.0f);
+
+  outUv = iUv.xy + corner * iUv.zw;
+  outCol = iCol;
+  outTexture = iTexture;
+}
@@ -0,0 +1,236 @@
+#include "batcher.h"
+
+void VKUIX::radixSort(std::vector<SortItem> &items, std::vector<SortItem> &scratch) {
+  if (items.size() < 2) return;
+  scratch.resize(items.size());
+
+  for (u32 shift = 0; shift < 64; shift += 8) {
+    u32 histogram[256]{};
+    for (const SortItem &item : items) histogram[item.key >> shift & 0xFF]++;
+
+    // Every key has the same byte, this pass would not move anything.
+    if (histogram[items[0].key >> shift & 0xFF] == items.size()) continue;
+
+    u32 offset = 0;
+    for (u32 &count : histogram) {
+      const u32 bucket = count;
+      count = offset;
+      offset += bucket;
+    }
+    for (const SortItem &item : items) scratch[histogram[item.key >> shift & 0xFF]++] = item;
+    items.swap(scratch);
+  }
+}
+
+VkDeviceSize VKUIX::DrawBatcher::uploadSize(RenderList &renderList) {
+  RenderList *list = &renderList;
+  return uploadSize(std::span{&list, 1});
+}
+
+VkDeviceSize VKUIX::DrawBatcher::uploadSize(const std::span<RenderList* const> renderLists) {
+  // Assumes 32 bit indices everywhere, plus alignment slack for every region.
+  VkDeviceSize size = 5 * 16;
+  for (RenderList *renderList : renderLists) {
+    size += renderList->getVertices().size() * sizeof(VkBackend::Vertex)
+            + renderList->getIndices().size() * sizeof(u32)
+            + renderList->getRects().size() * sizeof(VkBackend::RectInstance)
+            + renderList->getTextured().size() * sizeof(VkBackend::TexturedInstance);
+  }
+  return size;
+}
+
+void VKUIX::DrawBatcher::build(RenderList &renderList, Buffers::RingBuffer &ring) {
+  RenderList *list = &renderList;
+  build(std::span{&list, 1}, ring);
+}
+
+void VKUIX::DrawBatcher::build(const std::span<RenderList* const> renderLists, Buffers::RingBuffer &ring) {
+  if (renderLists.size() > UINT16_MAX) {
+    LOG(E, "DrawBatcher supports at most " << UINT16_MAX << " RenderLists, got " << renderLists.size() << ".");
+    return;
+  }
+
+  items.clear();
+  groups.clear();
+  draws.clear();
+  schedule.clear();
+  stats = {};
+
+  // Appended list by list, the stable sort keeps that order for equal keys.
+  for (u16 list = 0; list < renderLists.size(); ++list) {
+    const std::vector<DrawCmd> &commands = renderLists[list]->getCommands();
+    for (u32 i = 0; i < commands.size(); ++i) {
+      if (commands[i].count > 0) items.push_back({commands[i].key, i, list});
+    }
+  }
+  stats.commands = items.size();
+  radixSort(items, scratch);
+
+  const auto command = [&](const SortItem &item) -> const DrawCmd & {
+    return renderLists[item.list]->getCommands()[item.index];
+  };
+
+  // Group adjacent commands with equal keys. Triangle groups stay within the 16 bit vertex budget.
+  u32 vertexTotal = 0;
+  u32 index16Total = 0;
+  u32 index32Total = 0;
+  u32 instanceTotal = 0;
+  u32 texturedTotal = 0;
+
+  const auto closeGroup = [&] {
+    if (draws.empty()) return;
+    MergedDraw &draw = draws.back();
+    if (draw.pipeline == PipelineId::Triangles) {
+      vertexTotal += groups.back().vertexCount;
+      draw.indexType = groups.back().vertexCount <= RenderList::MAX_BATCH_VERTICES ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+      (draw.indexType == VK_INDEX_TYPE_UINT16 ? index16Total : index32Total) += draw.indexCount;
+    } else {
+      (draw.pipeline == PipelineId::Textured ? texturedTotal : instanceTotal) += draw.instanceCount;
+    }
+  };
+
+  for (u32 i = 0; i < items.size(); ++i) {
+    const DrawCmd &cmd = command(items[i]);
+
+    // Scissor indices are per list, so only unclipped commands merge across lists.
+    if (!draws.empty() && command(items[groups.back().itemBegin]).key == cmd.key && draws.back().opaque == cmd.opaque &&
+        (cmd.scissor == 0 || draws.back().list == items[i].list) &&
+        (cmd.pipeline != PipelineId::Triangles || groups.back().vertexCount + cmd.count <= RenderList::MAX_BATCH_VERTICES)) {
+      groups.back().itemEnd = i + 1;
+      MergedDraw &draw = draws.back();
+      if (cmd.pipeline == PipelineId::Triangles) {
+        groups.back().vertexCount += cmd.count;
+        draw.indexCount += cmd.indexCount;
+      } else {
+        draw.instanceCount += cmd.count;
+      }
+      continue;
+    }
+
+    closeGroup();
+    groups.push_back({i, i + 1, cmd.pipeline == PipelineId::Triangles ? cmd.count : 0});
+
+    MergedDraw draw{};
+    draw.pipeline = cmd.pipeline;
+    draw.layer = cmd.layer;
+    draw.scissor = cmd.scissor;
+    draw.list = items[i].list;
+    draw.opaque = cmd.opaque;
+    if (cmd.pipeline == PipelineId::Triangles) {
+      draw.indexCount = cmd.indexCount;
+    } else {
+      draw.instanceCount = cmd.count;
+    }
+    draws.push_back(draw);
+  }
+
+  closeGroup();
+
+  stats.draws = draws.size();
+  stats.merged = stats.commands - stats.draws;
+
+  u64 depthSteps = 0;
+  for (const MergedDraw &draw : draws)
+    depthSteps += draw.pipeline == PipelineId::RoundRect ? draw.instanceCount : 1;
+
+  // Without distinct depths the opaque pass would let hidden draws win. Everything is drawn in paint order instead,
+  // at one depth inside the clip volume, which leaves the depth buffer cleared and every depth test passing.
+  const bool depthOrdered = depthSteps <= MAX_DEPTH_STEPS;
+  if (!depthOrdered)
+    LOG_FIRST(W, 1, "Frame needs " << depthSteps << " depth steps, more than " << MAX_DEPTH_STEPS << ". Drawing it without the opaque pass.");
+  depthStep = depthOrdered ? DEPTH_STEP : 0.0f;
+
+  depthSteps = 0;
+  for (MergedDraw &draw : draws) {
+    draw.depth = depthOrdered ? 1.0f - static_cast<float>(depthSteps + 1) * DEPTH_STEP : FALLBACK_DEPTH;
+    depthSteps += draw.pipeline == PipelineId::RoundRect ? draw.instanceCount : 1;
+  }
+
+  for (u32 i = draws.size(); depthOrdered && i-- > 0;) {
+    if (draws[i].opaque) schedule.push_back({i, DrawPass::Opaque});
+  }
+  stats.opaque = schedule.size();
+  for (u32 i = 0; i < draws.size(); ++i) {
+    if (!depthOrdered || !draws[i].opaque || draws[i].pipeline == PipelineId::RoundRect) schedule.push_back({i, DrawPass::Translucent});
+  }
+
+  // Reserve one region per data kind, then gather every group into its region in sorted order.
+  vertexOffset = Buffers::allocRing(ring, vertexTotal * sizeof(VkBackend::Vertex));
+  index16Offset = Buffers::allocRing(ring, index16Total * sizeof(u16));
+  index32Offset = Buffers::allocRing(ring, index32Total * sizeof(u32));
+  instanceOffset = Buffers::allocRing(ring, instanceTotal * sizeof(VkBackend::RectInstance));
+  texturedOffset = Buffers::allocRing(ring, texturedTotal * sizeof(VkBackend::TexturedInstance));
+
+  auto *vertexDst = reinterpret_cast<VkBackend::Vertex*>(ring.mapped + vertexOffset);
+  auto *index16Dst = reinterpret_cast<u16*>(ring.mapped + index16Offset);
+  auto *index32Dst = reinterpret_cast<u32*>(ring.mapped + index32Offset);
+  auto *instanceDst = reinterpret_cast<VkBackend::RectInstance*>(ring.mapped + instanceOffset);
+  auto *texturedDst = reinterpret_cast<VkBackend::TexturedInstance*>(ring.mapped + texturedOffset);
+
+  u32 vertexCursor = 0;
+  u32 index16Cursor = 0;
+  u32 index32Cursor = 0;
+  u32 instanceCursor = 0;
+  u32 texturedCursor = 0;
+
+  for (u32 g = 0; g < groups.size(); ++g) {
+    const Group &group = groups[g];
+    MergedDraw &draw = draws[g];
+
+    if (draw.pipeline == PipelineId::RoundRect) {
+      draw.firstInstance = instanceCursor;
+      for (u32 i = group.itemBegin; i < group.itemEnd; ++i) {
+        const DrawCmd &cmd = command(items[i]);
+        const std::vector<VkBackend::RectInstance> &rects = renderLists[items[i].list]->getRects();
+        memcpy(instanceDst + instanceCursor, rects.data() + cmd.first, cmd.count * sizeof(VkBackend::RectInstance));
+        instanceCursor += cmd.count;
+      }
+      continue;
+    }
+
+    if (draw.pipeline == PipelineId::Textured) {
+      draw.firstInstance = texturedCursor;
+      for (u32 i = group.itemBegin; i < group.itemEnd; ++i) {
+        const DrawCmd &cmd = command(items[i]);
+        const std::vector<VkBackend::TexturedInstance> &instances = renderLists[items[i].list]->getTextured();
+        memcpy(texturedDst + texturedCursor, instances.data() + cmd.first, cmd.count * sizeof(VkBackend::TexturedInstance));
+        texturedCursor += cmd.count;
+      }
+      continue;
+    }
+
+    draw.vertexOffset = static_cast<int32_t>(vertexCursor);
+    const bool narrow = draw.indexType == VK_INDEX_TYPE_UINT16;
+    draw.firstIndex = narrow ? index16Cursor : index32Cursor;
+
+    for (u32 i = group.itemBegin; i < group.itemEnd; ++i) {
+      const DrawCmd &cmd = command(items[i]);
+      RenderList &list = *renderLists[items[i].list];
+      memcpy(vertexDst + vertexCursor, list.getVertices().data() + cmd.first, cmd.count * sizeof(VkBackend::Vertex));
+
+      // Indices are relative to the command, rebase them onto the group.
+      const u32 rebase = vertexCursor - draw.vertexOffset;
+      const u32 *src = list.getIndices().data() + cmd.firstIndex;
+      if (narrow) {
+        for (u32 j = 0; j < cmd.indexCount; ++j) index16Dst[index16Cursor + j] = static_cast<u16>(src[j] + rebase);
+        index16Cursor += cmd.indexCount;
+      } else {
+        for (u32 j = 0; j < cmd.indexCount; ++j) index32Dst[index32Cursor + j] = src[j] + rebase;
+        index32Cursor += cmd.indexCount;
+      }
+      vertexCursor += cmd.count;
+    }
+  }
+}
+
+const std::vector<VKUIX::MergedDraw> &VKUIX::DrawBatcher::getDraws() const {
+  return draws;
+}
+
+const std::vector<VKUIX::ScheduledDraw> &VKUIX::DrawBatcher::getSchedule() const {
+  return schedule;
+}
+
+const VKUIX::BatchStats &VKUIX::DrawBatcher::getStats() const {
+  return stats;
+}
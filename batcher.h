@@ -0,0 +1,113 @@
+#pragma once
+
+#include <span>
+
+#include "buffer.h"
+#include "renderlist.h"
+
+namespace VKUIX {
+
+  struct SortItem {
+    u64 key;
+    u32 index; // Command index within its RenderList
+    u16 list; // Index of the RenderList the command belongs to
+  };
+
+  // Stable LSD radix sort on SortItem::key, 8 bits per pass.
+  // Passes in which every key has the same byte are skipped.
+  void radixSort(std::vector<SortItem> &items, std::vector<SortItem> &scratch);
+
+  // One GPU draw after sorting and merging.
+  struct MergedDraw {
+    PipelineId pipeline;
+    u16 layer;
+    u16 scissor; // Index into the scissors of RenderList list
+    u16 list;
+    bool opaque; // See DrawCmd::opaque
+    float depth; // Of the first primitive, decreases in paint order. RoundRect instances are each one depthStep nearer than the one before
+
+    // Triangles: range in the index region of indexType, vertexOffset into the vertex region.
+    VkIndexType indexType;
+    u32 firstIndex;
+    u32 indexCount;
+    int32_t vertexOffset;
+
+    // RoundRect and Textured: range in the instance region of their instance type.
+    u32 firstInstance;
+    u32 instanceCount;
+  };
+
+  enum class DrawPass : u8 {
+    Opaque = 0, // Front to back, writes depth
+    Translucent = 1, // Back to front, blends over what is behind
+  };
+
+  // A merged draw and the pass it is issued in, see DrawBatcher::getSchedule.
+  struct ScheduledDraw {
+    u32 draw; // Index into DrawBatcher::getDraws()
+    DrawPass pass;
+  };
+
+  struct BatchStats {
+    u32 commands{0}; // Draw commands recorded by the RenderList
+    u32 draws{0}; // Draws left after merging
+    u32 merged{0}; // Commands folded into a previous draw
+    u32 opaque{0}; // Draws in the opaque pass
+  };
+
+  // Sorts the draw commands of one or more RenderLists by key and packs their data into the upload ring
+  // in sorted order, so commands with equal state become contiguous and merge into one draw.
+  // Several lists are merged straight from their own storage, commands with equal keys keep list order, then call order.
+  //
+  // The merged draws are scheduled in two passes over a depth buffer, every draw at its own depth and every RoundRect
+  // instance as well, since the translucent pass redraws their edges.
+  // Opaque draws go first, front to back, so early depth testing rejects the pixels they hide before shading them.
+  // The rest follows in paint order without writing depth, blending over whatever is behind it. Opaque RoundRect draws
+  // are part of both: the opaque pass draws their fully covered interior, the translucent pass the antialiased edge around it.
+  class DrawBatcher {
+  public:
+    // Depth between consecutive draws and RoundRect instances. Exact in D32_SFLOAT.
+    static constexpr float DEPTH_STEP = 1.0f / (1 << 20);
+    // Draws plus RoundRect instances with a depth of their own. Frames with more are scheduled without the opaque pass.
+    static constexpr u64 MAX_DEPTH_STEPS = 1 << 20;
+
+    // Upper bound of the ring bytes build() writes for the lists.
+    static VkDeviceSize uploadSize(RenderList &renderList);
+    static VkDeviceSize uploadSize(std::span<RenderList* const> renderLists);
+
+    // Writes into the current slice of ring, which must have room for uploadSize() bytes.
+    void build(RenderList &renderList, Buffers::RingBuffer &ring);
+    void build(std::span<RenderList* const> renderLists, Buffers::RingBuffer &ring);
+
+    [[nodiscard]] const std::vector<MergedDraw> &getDraws() const;
+    // Order the draws are issued in: the opaque pass, then the translucent pass.
+    [[nodiscard]] const std::vector<ScheduledDraw> &getSchedule() const;
+    [[nodiscard]] const BatchStats &getStats() const;
+
+    // Absolute ring offsets of the regions written by the last build().
+    VkDeviceSize vertexOffset{0};
+    VkDeviceSize index16Offset{0};
+    VkDeviceSize index32Offset{0};
+    VkDeviceSize instanceOffset{0};
+    VkDeviceSize texturedOffset{0};
+    // Depth between the instances of a RoundRect draw in the last build(), pushed to roundrect.vert.
+    // DEPTH_STEP, or 0 when the frame had too many steps and every draw sits at FALLBACK_DEPTH.
+    float depthStep{DEPTH_STEP};
+    static constexpr float FALLBACK_DEPTH = 0.5f;
+
+  private:
+    struct Group {
+      u32 itemBegin;
+      u32 itemEnd;
+      u32 vertexCount;
+    };
+
+    std::vector<SortItem> items;
+    std::vector<SortItem> scratch;
+    std::vector<Group> groups;
+    std::vector<MergedDraw> draws;
+    std::vector<ScheduledDraw> schedule;
+    BatchStats stats{};
+  };
+
+}
@@ -0,0 +1,291 @@
+// CPU microbenchmarks for the parts of a frame that do not need a Vulkan device:
+// RenderList tessellation, vertex packing and DrawBatcher uploads into a host memory ring.
+// The sharded benchmarks fill one RenderList per hardware thread in parallel and merge them in one build.
+//
+// Usage: vkuix_bench [--out results.json] [--min-time seconds]
+// Results are written as JSON, to stdout when no file is given.
+
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "batcher.h"
+#include "renderlist.h"
+
+namespace {
+
+  using Clock = std::chrono::steady_clock;
+
+  struct Result {
+    std::string name;
+    std::string params; // JSON object with the parameters of the run
+    u64 iterations;
+    double nsPerIteration;
+    double itemsPerSecond; // Primitives or vertices, depending on the benchmark
+    double bytesPerSecond; // 0 when not applicable
+  };
+
+  double minTime = 0.25;
+  std::vector<Result> results{};
+
+  // Keeps the optimizer from dropping the measured work.
+  volatile u64 sink = 0;
+
+  // Runs fn until at least minTime seconds have passed, after one untimed warmup run.
+  // itemsPerIteration and bytesPerIteration scale the reported throughput.
+  template <typename F>
+  void bench(const std::string &name, const std::string &params, const double itemsPerIteration, const double bytesPerIteration, F &&fn) {
+    fn();
+
+    u64 iterations = 0;
+    const Clock::time_point start = Clock::now();
+    double elapsed = 0.0;
+    do {
+      fn();
+      ++iterations;
+      elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    } while (elapsed < minTime);
+
+    const double perIteration = elapsed / static_cast<double>(iterations);
+    results.push_back({name, params, iterations, perIteration * 1e9, itemsPerIteration / perIteration,
+                       bytesPerIteration > 0.0 ? bytesPerIteration / perIteration : 0.0});
+    std::cerr << name << " " << params << ": " << perIteration * 1e9 << " ns/iter" << std::endl;
+  }
+
+  // Host memory stand-in for the persistently mapped upload ring, so packing can be measured without a device.
+  struct HostRing {
+    std::vector<u8> memory;
+    Buffers::RingBuffer ring{};
+
+    explicit HostRing(const VkDeviceSize size) : memory(size) {
+      ring.mapped = memory.data();
+      ring.sliceSize = size;
+      ring.sliceCount = 1;
+    }
+  };
+
+  // Emits count primitives spread over a 1920x1080 area, every fourth one crossing the viewport edge.
+  void emitRects(VKUIX::RenderList &list, const u32 count) {
+    for (u32 i = 0; i < count; ++i) {
+      const float x = static_cast<float>(i * 37 % 1900) - (i % 4 == 0 ? 10.0f : 0.0f);
+      const float y = static_cast<float>(i * 53 % 1060);
+      list.rect(x, y, 20.0f, 12.0f, VKUIX::Color(i & 0xFF, 40, 40));
+    }
+  }
+
+  void emitRoundRects(VKUIX::RenderList &list, const u32 count) {
+    for (u32 i = 0; i < count; ++i) {
+      const float x = static_cast<float>(i * 37 % 1900) - (i % 4 == 0 ? 10.0f : 0.0f);
+      const float y = static_cast<float>(i * 53 % 1060);
+      list.roundRect(x, y, 20.0f, 12.0f, {4.0f}, VKUIX::Color(i & 0xFF, 40, 40));
+    }
+  }
+
+  void emitRoundRectMeshes(VKUIX::RenderList &list, const u32 count, const int subdiv) {
+    for (u32 i = 0; i < count; ++i) {
+      const float x = static_cast<float>(i * 37 % 1900) - (i % 4 == 0 ? 10.0f : 0.0f);
+      const float y = static_cast<float>(i * 53 % 1060);
+      list.roundRectMesh(x, y, 20.0f, 12.0f, {4.0f}, subdiv, VKUIX::Color(i & 0xFF, 40, 40));
+    }
+  }
+
+  // A typical UI mix: mostly SDF rects, some plain rects and meshes, nested clips and two layers.
+  void emitMixed(VKUIX::RenderList &list, const u32 count) {
+    for (u32 i = 0; i < count; ++i) {
+      if (i % 64 == 0) {
+        if (i) list.popClipRect();
+        list.pushClipRect(static_cast<float>(i % 800), 0.0f, 400.0f, 1080.0f);
+      }
+      if (i % 256 == 0) list.setLayer(static_cast<u16>(i / 256 % 2));
+
+      const float x = static_cast<float>(i * 37 % 1900);
+      const float y = static_cast<float>(i * 53 % 1060);
+      switch (i % 8) {
+        case 0: list.rect(x, y, 20.0f, 12.0f, VKUIX::Color(30, 30, 30)); break;
+        case 1: list.roundRectMesh(x, y, 20.0f, 12.0f, {4.0f}, 4, VKUIX::Color(60, 60, 60)); break;
+        default: list.roundRect(x, y, 20.0f, 12.0f, {4.0f}, VKUIX::Color(41, 41, 43)); break;
+      }
+    }
+    if (count) list.popClipRect();
+  }
+
+  std::string param(const char *key, const u32 value) {
+    return std::string("{\"") + key + "\": " + std::to_string(value) + "}";
+  }
+
+  void benchPrimitives() {
+    constexpr u32 COUNT = 10000;
+    VKUIX::RenderList list{};
+    list.setViewport({1920, 1080});
+
+    bench("primitives.rect", param("count", COUNT), COUNT, 0.0, [&] {
+      list.clear();
+      emitRects(list, COUNT);
+      sink = sink + list.getVertices().size();
+    });
+
+    bench("primitives.roundRect", param("count", COUNT), COUNT, 0.0, [&] {
+      list.clear();
+      emitRoundRects(list, COUNT);
+      sink = sink + list.getRects().size();
+    });
+
+    for (const int subdiv : {1, 2, 4, 8, 16}) {
+      bench("primitives.roundRectMesh", "{\"count\": " + std::to_string(COUNT) + ", \"subdiv\": " + std::to_string(subdiv) + "}",
+            COUNT, 0.0, [&] {
+              list.clear();
+              emitRoundRectMeshes(list, COUNT, subdiv);
+              sink = sink + list.getVertices().size();
+            });
+    }
+  }
+
+  void benchPacking() {
+    constexpr u32 COUNT = 100000;
+
+    std::vector<VkBackend::Vertex> vertices(COUNT);
+    for (u32 i = 0; i < COUNT; ++i)
+      vertices[i] = {{static_cast<float>(i % 1920) + 0.25f, static_cast<float>(i % 1080) + 0.75f}, VKUIX::Color(i & 0xFF, 0, 0)};
+
+    std::vector<VkBackend::RectInstance> rects(COUNT);
+    for (u32 i = 0; i < COUNT; ++i)
+      rects[i] = {{static_cast<float>(i % 1920), static_cast<float>(i % 1080), 20.0f, 12.0f}, glm::vec4(4.0f), VKUIX::Color(i & 0xFF, 0, 0), {}, 0.0f, 0.0f};
+
+    HostRing host{COUNT * sizeof(VkBackend::RectInstance) + 256};
+
+    bench("pack.Vertex", param("count", COUNT), COUNT, COUNT * sizeof(VkBackend::Vertex), [&] {
+      Buffers::beginRingSlice(host.ring, 0);
+      sink = sink + Buffers::pushRing(host.ring, vertices);
+    });
+
+    // Quantized on the fly, which is what an upload of QuantizedVertex costs.
+    bench("pack.QuantizedVertex", param("count", COUNT), COUNT, COUNT * sizeof(VkBackend::QuantizedVertex), [&] {
+      Buffers::beginRingSlice(host.ring, 0);
+      const VkDeviceSize offset = Buffers::allocRing(host.ring, COUNT * sizeof(VkBackend::QuantizedVertex));
+      auto *dst = reinterpret_cast<VkBackend::QuantizedVertex*>(host.ring.mapped + offset);
+      for (u32 i = 0; i < COUNT; ++i) dst[i] = VkBackend::QuantizedVertex::quantize(vertices[i]);
+      sink = sink + dst[COUNT - 1].pos.x;
+    });
+
+    bench("pack.RectInstance", param("count", COUNT), COUNT, COUNT * sizeof(VkBackend::RectInstance), [&] {
+      Buffers::beginRingSlice(host.ring, 0);
+      sink = sink + Buffers::pushRing(host.ring, rects);
+    });
+  }
+
+  void benchRebuild() {
+    for (const u32 count : {1000u, 10000u, 100000u}) {
+      VKUIX::RenderList list{};
+      list.setViewport({1920, 1080});
+      emitMixed(list, count);
+
+      bench("rebuild.clear", param("count", count), count, 0.0, [&] {
+        list.clear();
+        sink = sink + list.getVertices().capacity();
+      });
+
+      bench("rebuild.record", param("count", count), count, 0.0, [&] {
+        list.clear();
+        emitMixed(list, count);
+        sink = sink + list.getCommands().size();
+      });
+
+      // Sorting, merging and packing into the ring, what render() does before recording.
+      list.clear();
+      emitMixed(list, count);
+      HostRing host{VKUIX::DrawBatcher::uploadSize(list)};
+      VKUIX::DrawBatcher batcher{};
+      bench("rebuild.batch", param("count", count), count, static_cast<double>(VKUIX::DrawBatcher::uploadSize(list)), [&] {
+        Buffers::beginRingSlice(host.ring, 0);
+        batcher.build(list, host.ring);
+        sink = sink + batcher.getDraws().size();
+      });
+    }
+  }
+
+  // The rebuild benchmarks at 100k primitives, split over one shard per hardware thread.
+  void benchSharded() {
+    constexpr u32 COUNT = 100000;
+    const u32 shardCount = glm::max(std::thread::hardware_concurrency(), 1u);
+    const std::string params = "{\"count\": " + std::to_string(COUNT) + ", \"shards\": " + std::to_string(shardCount) + "}";
+
+    std::vector<std::unique_ptr<VKUIX::RenderList>> shards(shardCount);
+    std::vector<VKUIX::RenderList*> lists(shardCount);
+    for (u32 i = 0; i < shardCount; ++i) {
+      shards[i] = std::make_unique<VKUIX::RenderList>();
+      shards[i]->setViewport({1920, 1080});
+      lists[i] = shards[i].get();
+    }
+
+    const auto fill = [&] {
+      std::vector<std::thread> threads{};
+      threads.reserve(shardCount);
+      for (u32 i = 0; i < shardCount; ++i) {
+        threads.emplace_back([&, i] {
+          VKUIX::RenderList &list = *lists[i];
+          list.clear();
+          emitMixed(list, COUNT / shardCount + (i < COUNT % shardCount ? 1 : 0));
+        });
+      }
+      for (std::thread &thread : threads) thread.join();
+    };
+
+    // Includes starting and joining the threads, which a real frame would amortize with a pool.
+    bench("rebuild.recordSharded", params, COUNT, 0.0, [&] {
+      fill();
+      sink = sink + lists[0]->getCommands().size();
+    });
+
+    fill();
+    HostRing host{VKUIX::DrawBatcher::uploadSize(lists)};
+    VKUIX::DrawBatcher batcher{};
+    bench("rebuild.batchSharded", params, COUNT, static_cast<double>(VKUIX::DrawBatcher::uploadSize(lists)), [&] {
+      Buffers::beginRingSlice(host.ring, 0);
+      batcher.build(lists, host.ring);
+      sink = sink + batcher.getDraws().size();
+    });
+  }
+
+  void writeJson(std::ostream &out) {
+    out << "{\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+      const Result &r = results[i];
+      out << "    {\"name\": \"" << r.name << "\", \"params\": " << r.params
+          << ", \"iterations\": " << r.iterations
+          << ", \"ns_per_iteration\": " << r.nsPerIteration
+          << ", \"items_per_second\": " << r.itemsPerSecond
+          << ", \"bytes_per_second\": " << r.bytesPerSecond << "}"
+          << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+  }
+
+}
+
+int main(const int argc, char **argv) {
+  std::string outPath{};
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "--out" && i + 1 < argc) outPath = argv[++i];
+    else if (arg == "--min-time" && i + 1 < argc) minTime = std::stod(argv[++i]);
+    else {
+      std::cerr << "Usage: vkuix_bench [--out results.json] [--min-time seconds]" << std::endl;
+      return 1;
+    }
+  }
+
+  benchPrimitives();
+  benchPacking();
+  benchRebuild();
+  benchSharded();
+
+  if (outPath.empty()) {
+    writeJson(std::cout);
+  } else {
+    std::ofstream file{outPath};
+    writeJson(file);
+  }
+  return 0;
+}
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <cstring>
+#include <vector>
+
 #include <vma/vk_mem_alloc.h>
 #include <vulkan/vulkan.h>
 
@@ -8,8 +11,8 @@
 namespace Buffers {
 
   struct Buffer {
-    VkBuffer buffer;
-    VmaAllocation allocation;
+    VkBuffer buffer{};
+    VmaAllocation allocation{};
   };
 
   template <typename T>
@@ -51,12 +54,183 @@ namespace Buffers {
     vmaMapMemory(allocator, buffer.allocation, &tempData);
     memcpy(tempData, data.data(), data.size() * sizeof(data[0]));
     vmaUnmapMemory(allocator, buffer.allocation);
-    vmaFreeMemory(allocator, buffer.allocation);
+  }
+
+  // Device local buffer, filled by copies instead of mapping it. Shared concurrently if sharedFamilies names more than one family.
+  inline void createDeviceBuffer(
+    const VmaAllocator &allocator,
+    Buffer &bufferOut,
+    const VkDeviceSize size,
+    const VkBufferUsageFlags usageFlags,
+    const std::vector<u32> &sharedFamilies = {}) {
+
+    VkBufferCreateInfo bufferInfo{VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+    bufferInfo.size = size;
+    bufferInfo.usage = usageFlags | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if (sharedFamilies.size() > 1) {
+      bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+      bufferInfo.queueFamilyIndexCount = sharedFamilies.size();
+      bufferInfo.pQueueFamilyIndices = sharedFamilies.data();
+    }
+
+    VmaAllocationCreateInfo allocInfo{};
+    allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+    if (vmaCreateBuffer(allocator, &bufferInfo, &allocInfo, &bufferOut.buffer, &bufferOut.allocation, nullptr) != VK_SUCCESS) {
+      LOG(W, "Could not allocate device local Buffer of " << size << " bytes.");
+    }
+  }
+
+  inline void freeBuffer(Buffer &buffer, VmaAllocator allocator) {
+    if (!buffer.buffer) return;
+    vmaDestroyBuffer(allocator, buffer.buffer, buffer.allocation);
+    buffer = {};
+  }
+
+  // Persistently mapped buffer the device writes into and the host reads from, e.g. a copied render target.
+  struct ReadbackBuffer {
+    Buffer buffer{};
+    u8 *mapped{nullptr};
+    VkDeviceSize size{0};
+  };
+
+  inline void createReadbackBuffer(const VmaAllocator &allocator, ReadbackBuffer &readbackOut, const VkDeviceSize size) {
+    VkBufferCreateInfo bufferInfo{VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+    bufferInfo.size = size;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VmaAllocationCreateInfo allocInfo{};
+    allocInfo.usage = VMA_MEMORY_USAGE_GPU_TO_CPU;
+    allocInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+    VmaAllocationInfo allocResult{};
+    if (vmaCreateBuffer(allocator, &bufferInfo, &allocInfo, &readbackOut.buffer.buffer, &readbackOut.buffer.allocation, &allocResult) != VK_SUCCESS) {
+      LOG(F, "Could not allocate ReadbackBuffer of " << size << " bytes.");
+    }
+    readbackOut.mapped = static_cast<u8*>(allocResult.pMappedData);
+    readbackOut.size = size;
+  }
+
+  inline void destroyReadbackBuffer(const VmaAllocator &allocator, ReadbackBuffer &readback) {
+    freeBuffer(readback.buffer, allocator);
+    readback = {};
+  }
+
+  // Makes device writes visible to the host after the copy has completed. No-op on host coherent memory.
+  inline void invalidateReadback(const VmaAllocator &allocator, const ReadbackBuffer &readback) {
+    vmaInvalidateAllocation(allocator, readback.buffer.allocation, 0, readback.size);
+  }
+
+  // Persistently mapped host visible buffer, split into one slice per frame in flight.
+  // A slice must only be written after the RenderFrame::renderFence of the frame owning it was waited on.
+  struct RingBuffer {
+    Buffer buffer{};
+    u8 *mapped{nullptr};
+    VkBufferUsageFlags usageFlags{};
+
+    VkDeviceSize sliceSize{0};
+    u32 sliceCount{0};
+
+    u32 currentSlice{0};
+    VkDeviceSize cursor{0}; // Write offset relative to the start of currentSlice.
+
+    VkDeviceSize highWaterMark{0}; // Most bytes ever written into a single slice.
+    u32 growCount{0};
+  };
+
+  inline VkDeviceSize alignUp(const VkDeviceSize value, const VkDeviceSize alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+  }
+
+  inline void createRingBuffer(
+    const VmaAllocator &allocator,
+    RingBuffer &ringOut,
+    const VkDeviceSize sliceSize,
+    const u32 sliceCount,
+    const VkBufferUsageFlags usageFlags) {
+
+    ringOut.usageFlags = usageFlags;
+    ringOut.sliceSize = alignUp(sliceSize, 256);
+    ringOut.sliceCount = sliceCount;
+    ringOut.currentSlice = 0;
+    ringOut.cursor = 0;
+
+    VkBufferCreateInfo bufferInfo{VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+    bufferInfo.size = ringOut.sliceSize * sliceCount;
+    bufferInfo.usage = usageFlags;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VmaAllocationCreateInfo allocInfo{};
+    allocInfo.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+    allocInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+    VmaAllocationInfo allocResult{};
+    if (vmaCreateBuffer(allocator, &bufferInfo, &allocInfo, &ringOut.buffer.buffer, &ringOut.buffer.allocation, &allocResult) != VK_SUCCESS) {
+      LOG(F, "Could not allocate RingBuffer of " << bufferInfo.size << " bytes.");
+    }
+    ringOut.mapped = static_cast<u8*>(allocResult.pMappedData);
+  }
+
+  inline void destroyRingBuffer(const VmaAllocator &allocator, RingBuffer &ring) {
+    freeBuffer(ring.buffer, allocator);
+    ring.mapped = nullptr;
+  }
+
+  // Starts writing into the slice of the given frame. Previous contents of that slice are discarded.
+  inline void beginRingSlice(RingBuffer &ring, const u32 slice) {
+    ring.currentSlice = slice % ring.sliceCount;
+    ring.cursor = 0;
+  }
+
+  [[nodiscard]] inline bool ringFits(const RingBuffer &ring, const VkDeviceSize bytes) {
+    return bytes <= ring.sliceSize;
+  }
+
+  // Recreates the ring with at least requiredSliceSize bytes per slice, growing geometrically.
+  // Every slice is dropped, so the caller has to make sure no frame in flight still reads from the ring.
+  inline void growRingBuffer(const VmaAllocator &allocator, RingBuffer &ring, const VkDeviceSize requiredSliceSize) {
+    VkDeviceSize newSize = ring.sliceSize ? ring.sliceSize : 1;
+    while (newSize < requiredSliceSize) newSize *= 2;
+
+    const u32 slice = ring.currentSlice;
+    const u32 growCount = ring.growCount;
+    const VkDeviceSize highWaterMark = ring.highWaterMark;
+
+    LOG(D, "Growing RingBuffer slices from " << ring.sliceSize << " to " << newSize << " bytes.");
+    destroyRingBuffer(allocator, ring);
+    createRingBuffer(allocator, ring, newSize, ring.sliceCount, ring.usageFlags);
+
+    ring.currentSlice = slice;
+    ring.growCount = growCount + 1;
+    ring.highWaterMark = highWaterMark;
+  }
+
+  // Reserves size bytes in the current slice and returns the absolute buffer offset of the reservation.
+  // The mapped memory for the reservation starts at ring.mapped + returned offset.
+  inline VkDeviceSize allocRing(RingBuffer &ring, const VkDeviceSize size, const VkDeviceSize alignment = 16) {
+    const VkDeviceSize start = alignUp(ring.cursor, alignment);
+    if (start + size > ring.sliceSize) {
+      LOG(F, "RingBuffer slice overflow (" << start + size << " > " << ring.sliceSize << "). Reserve with ringFits/growRingBuffer first.");
+    }
+    ring.cursor = start + size;
+    ring.highWaterMark = std::max(ring.highWaterMark, ring.cursor);
+    return ring.currentSlice * ring.sliceSize + start;
   }
 
   template <typename T>
-  void freeBuffer(Buffer &buffer, VmaAllocator allocator) {
+  VkDeviceSize pushRing(RingBuffer &ring, const std::vector<T> &data, const VkDeviceSize alignment = 16) {
+    const VkDeviceSize size = data.size() * sizeof(T);
+    const VkDeviceSize offset = allocRing(ring, size, alignment);
+    if (size) memcpy(ring.mapped + offset, data.data(), size);
+    return offset;
+  }
 
+  // Makes the writes of the current slice visible to the device. No-op on host coherent memory.
+  inline void flushRingSlice(const VmaAllocator &allocator, const RingBuffer &ring) {
+    if (ring.cursor == 0) return;
+    vmaFlushAllocation(allocator, ring.buffer.allocation, ring.currentSlice * ring.sliceSize, ring.cursor);
   }
 
-}
\ No newline at end of file
+}
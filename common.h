@@ -11,6 +11,8 @@
 // Primitive Types
 using u32 = uint32_t;
 using u16 = uint16_t;
+using u8 = uint8_t;
+using u64 = uint64_t;
 
 // Memory
 template <typename T>
@@ -32,24 +34,27 @@ namespace VKUIX {
     glm::vec3 rotation{0.0f};
   };
 
+  // RGBA8 color packed into one u32, red in the lowest byte. Matches VK_FORMAT_R8G8B8A8_UNORM,
+  // so it can be written into vertex and instance data as is.
   struct Color {
-    float r;
-    float g;
-    float b;
-    float a;
-
-    Color toDecimal() {
-      r = r/255.0f;
-      g = g/255.0f;
-      b = b/255.0f;
-      a = a/255.0f;
-      return *this;
-    }
+    u32 rgba{0};
+
+    constexpr Color() = default;
+    constexpr Color(const u32 r, const u32 g, const u32 b, const u32 a = 255)
+      : rgba((r & 0xFF) | (g & 0xFF) << 8 | (b & 0xFF) << 16 | (a & 0xFF) << 24) {}
+
+    [[nodiscard]] constexpr u8 r() const { return rgba & 0xFF; }
+    [[nodiscard]] constexpr u8 g() const { return rgba >> 8 & 0xFF; }
+    [[nodiscard]] constexpr u8 b() const { return rgba >> 16 & 0xFF; }
+    [[nodiscard]] constexpr u8 a() const { return rgba >> 24 & 0xFF; }
+
+    [[nodiscard]] constexpr u32 packed() const { return rgba; }
 
     [[nodiscard]] glm::vec4 glmDecimal() const {
-      return {r/255.0f, g/255.0f, b/255.0f, a/255.0f};
+      return {r()/255.0f, g()/255.0f, b()/255.0f, a()/255.0f};
     }
 
+    constexpr bool operator==(const Color &) const = default;
   };
 
 }
\ No newline at end of file
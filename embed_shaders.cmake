@@ -0,0 +1,64 @@
+# Turns compiled SPIR-V files into a header of constexpr uint32_t arrays, see shader.h.
+#
+#   cmake -DOUTPUT=embedded_shaders.h -DSPIRV_FILES="a.vert.spv|a.frag.spv" -P embed_shaders.cmake
+#
+# SPIRV_FILES is separated by | since custom commands do not pass lists through intact.
+# Files have to be named <shader>.<stage>.spv. SPIR-V is a stream of little endian words,
+# so every four bytes become one word.
+
+if(NOT OUTPUT OR NOT SPIRV_FILES)
+  message(FATAL_ERROR "embed_shaders.cmake needs OUTPUT and SPIRV_FILES.")
+endif()
+string(REPLACE "|" ";" SPIRV_FILES "${SPIRV_FILES}")
+
+set(arrays "")
+set(entries "")
+foreach(spirv IN LISTS SPIRV_FILES)
+  get_filename_component(file_name "${spirv}" NAME)
+  string(REGEX MATCH "^(.+)\\.([a-z]+)\\.spv$" matched "${file_name}")
+  if(NOT matched)
+    message(FATAL_ERROR "${file_name} is not named <shader>.<stage>.spv.")
+  endif()
+  set(shader "${CMAKE_MATCH_1}")
+  set(stage "${CMAKE_MATCH_2}")
+  string(MAKE_C_IDENTIFIER "${shader}_${stage}" identifier)
+
+  file(READ "${spirv}" hex HEX)
+  string(LENGTH "${hex}" hex_length)
+  math(EXPR remainder "${hex_length} % 8")
+  if(hex_length EQUAL 0 OR NOT remainder EQUAL 0)
+    message(FATAL_ERROR "${file_name} is not a whole number of SPIR-V words.")
+  endif()
+
+  # aabbccdd in file order is the word 0xddccbbaa.
+  string(REGEX REPLACE "(..)(..)(..)(..)" "0x\\4\\3\\2\\1u," words "${hex}")
+  string(REPEAT "0x[0-9a-f]+u," 8 line)
+  string(REGEX REPLACE "(${line})" "\\1\n    " words "${words}")
+  string(STRIP "${words}" words)
+
+  string(APPEND arrays "  alignas(4) inline constexpr uint32_t ${identifier}[] = {\n    ${words}\n  };\n\n")
+  string(APPEND entries "    {\"${shader}\", \"${stage}\", ${identifier}},\n")
+endforeach()
+
+set(content "#pragma once
+
+// Generated by embed_shaders.cmake from assets/shader, do not edit.
+
+#include <cstdint>
+#include <span>
+
+namespace EmbeddedShaders {
+
+${arrays}  struct Entry {
+    const char *shader;
+    const char *stage;
+    std::span<const uint32_t> code;
+  };
+
+  inline constexpr Entry ENTRIES[] = {
+${entries}  };
+
+}
+")
+
+file(WRITE "${OUTPUT}" "${content}")
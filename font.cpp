@@ -0,0 +1,454 @@
+#include "font.h"
+
+#include <cfloat>
+#include <cstring>
+#include <fstream>
+
+#include "profiler.h"
+
+// Composite glyphs may nest, but real fonts rarely go deeper than two or three levels.
+static constexpr u32 MAX_COMPOSITE_DEPTH = 8;
+
+// Simple glyph flags
+static constexpr u8 ON_CURVE = 0x01;
+static constexpr u8 X_SHORT = 0x02;
+static constexpr u8 Y_SHORT = 0x04;
+static constexpr u8 REPEAT = 0x08;
+static constexpr u8 X_SAME_OR_POSITIVE = 0x10;
+static constexpr u8 Y_SAME_OR_POSITIVE = 0x20;
+
+// Composite glyph flags
+static constexpr u16 ARGS_ARE_WORDS = 0x0001;
+static constexpr u16 ARGS_ARE_XY = 0x0002;
+static constexpr u16 HAS_SCALE = 0x0008;
+static constexpr u16 MORE_COMPONENTS = 0x0020;
+static constexpr u16 HAS_XY_SCALE = 0x0040;
+static constexpr u16 HAS_2X2 = 0x0080;
+
+u8 VKUIX::Font::readU8(const u32 offset) const {
+  return offset < data.size() ? data[offset] : 0;
+}
+
+u16 VKUIX::Font::readU16(const u32 offset) const {
+  return static_cast<u16>(readU8(offset) << 8 | readU8(offset + 1));
+}
+
+int16_t VKUIX::Font::readI16(const u32 offset) const {
+  return static_cast<int16_t>(readU16(offset));
+}
+
+u32 VKUIX::Font::readU32(const u32 offset) const {
+  return static_cast<u32>(readU16(offset)) << 16 | readU16(offset + 2);
+}
+
+u32 VKUIX::Font::findTable(const char *tag) const {
+  const u16 numTables = readU16(4);
+  for (u32 i = 0; i < numTables; ++i) {
+    const u32 record = 12 + 16 * i;
+    if (record + 16 > data.size()) break;
+    if (memcmp(data.data() + record, tag, 4) == 0) {
+      const u32 offset = readU32(record + 8);
+      return offset < data.size() ? offset : 0;
+    }
+  }
+  return 0;
+}
+
+bool VKUIX::Font::loadFile(const std::string &path) {
+  std::ifstream file{path, std::ios::binary | std::ios::ate};
+  if (!file) {
+    LOG(W, "Could not open font " << path);
+    return false;
+  }
+  std::vector<u8> fileData(static_cast<size_t>(file.tellg()));
+  file.seekg(0);
+  file.read(reinterpret_cast<char*>(fileData.data()), static_cast<std::streamsize>(fileData.size()));
+
+  if (!load(std::move(fileData))) {
+    LOG(W, "Font " << path << " is not a TrueType font with glyf outlines.");
+    return false;
+  }
+  return true;
+}
+
+bool VKUIX::Font::load(std::vector<u8> fileData) {
+  data = std::move(fileData);
+
+  const u32 version = readU32(0);
+  if (version != 0x00010000 && version != 0x74727565) return false; // 1.0 or 'true', 'OTTO' would be CFF
+
+  const u32 head = findTable("head");
+  const u32 hhea = findTable("hhea");
+  const u32 maxp = findTable("maxp");
+  const u32 cmapTable = findTable("cmap");
+  glyf = findTable("glyf");
+  loca = findTable("loca");
+  hmtx = findTable("hmtx");
+  if (!head || !hhea || !maxp || !cmapTable || !glyf || !loca || !hmtx) return false;
+
+  unitsPerEm = readU16(head + 18);
+  longLoca = readI16(head + 50) != 0;
+  numGlyphs = readU16(maxp + 4);
+  ascent = readI16(hhea + 4);
+  descent = readI16(hhea + 6);
+  lineGap = readI16(hhea + 8);
+  numHMetrics = readU16(hhea + 34);
+  if (unitsPerEm == 0 || numGlyphs == 0 || numHMetrics == 0) return false;
+
+  // Prefer a full Unicode subtable (format 12) over a BMP only one (format 4).
+  cmap = 0;
+  cmapFormat = 0;
+  const u16 subtables = readU16(cmapTable + 2);
+  for (u32 i = 0; i < subtables; ++i) {
+    const u32 record = cmapTable + 4 + 8 * i;
+    const u16 platform = readU16(record);
+    const u16 encoding = readU16(record + 2);
+    const u32 subtable = cmapTable + readU32(record + 4);
+    const bool unicode = platform == 0 || (platform == 3 && (encoding == 1 || encoding == 10));
+    if (!unicode) continue;
+
+    const u16 format = readU16(subtable);
+    if (format == 12 || (format == 4 && cmapFormat != 12)) {
+      cmap = subtable;
+      cmapFormat = format;
+    }
+  }
+  return cmapFormat != 0;
+}
+
+u16 VKUIX::Font::glyphIndex(const u32 codepoint) const {
+  if (cmapFormat == 12) {
+    const u32 groups = readU32(cmap + 12);
+    u32 low = 0, high = groups;
+    while (low < high) {
+      const u32 mid = (low + high) / 2;
+      const u32 group = cmap + 16 + 12 * mid;
+      if (codepoint < readU32(group)) high = mid;
+      else if (codepoint > readU32(group + 4)) low = mid + 1;
+      else return static_cast<u16>(readU32(group + 8) + codepoint - readU32(group));
+    }
+    return 0;
+  }
+
+  if (cmapFormat == 4 && codepoint <= 0xFFFF) {
+    const u32 segCount = readU16(cmap + 6) / 2;
+    const u32 endCodes = cmap + 14;
+    const u32 startCodes = endCodes + 2 * segCount + 2;
+    const u32 idDeltas = startCodes + 2 * segCount;
+    const u32 idRangeOffsets = idDeltas + 2 * segCount;
+
+    // First segment whose end is at or after the codepoint.
+    u32 low = 0, high = segCount;
+    while (low < high) {
+      const u32 mid = (low + high) / 2;
+      if (readU16(endCodes + 2 * mid) < codepoint) low = mid + 1;
+      else high = mid;
+    }
+    if (low == segCount) return 0;
+
+    const u16 start = readU16(startCodes + 2 * low);
+    if (codepoint < start) return 0;
+    const u16 delta = readU16(idDeltas + 2 * low);
+    const u16 rangeOffset = readU16(idRangeOffsets + 2 * low);
+    if (rangeOffset == 0) return static_cast<u16>(codepoint + delta);
+
+    // idRangeOffset is relative to its own position in the array.
+    const u16 glyph = readU16(idRangeOffsets + 2 * low + rangeOffset + 2 * (codepoint - start));
+    return glyph ? static_cast<u16>(glyph + delta) : 0;
+  }
+  return 0;
+}
+
+float VKUIX::Font::scaleForSize(const float pixelSize) const {
+  return unitsPerEm ? pixelSize / static_cast<float>(unitsPerEm) : 0.0f;
+}
+
+float VKUIX::Font::getAdvance(const u16 glyph) const {
+  // Glyphs past numHMetrics share the last advance.
+  const u32 metric = glm::min<u32>(glyph, numHMetrics - 1);
+  return readU16(hmtx + 4 * metric);
+}
+
+float VKUIX::Font::getAscent() const {
+  return ascent;
+}
+
+float VKUIX::Font::getDescent() const {
+  return descent;
+}
+
+float VKUIX::Font::getLineGap() const {
+  return lineGap;
+}
+
+bool VKUIX::Font::glyphRange(const u16 glyph, u32 &startOut, u32 &endOut) const {
+  if (glyph >= numGlyphs) return false;
+  if (longLoca) {
+    startOut = readU32(loca + 4 * glyph);
+    endOut = readU32(loca + 4 * glyph + 4);
+  } else {
+    startOut = readU16(loca + 2 * glyph) * 2u;
+    endOut = readU16(loca + 2 * glyph + 2) * 2u;
+  }
+  startOut += glyf;
+  endOut += glyf;
+  return startOut <= endOut && endOut <= data.size();
+}
+
+void VKUIX::Font::flattenQuad(const glm::vec2 p0, const glm::vec2 p1, const glm::vec2 p2, std::vector<Line> &linesOut) {
+  // Segment count from the curve's deviation from a straight line, in pixels.
+  const glm::vec2 deviation = p0 - 2.0f * p1 + p2;
+  const float deviationSq = glm::dot(deviation, deviation);
+  if (deviationSq < 0.333f) {
+    linesOut.push_back({p0, p2});
+    return;
+  }
+
+  constexpr float TOLERANCE = 3.0f;
+  const u32 segments = 1 + static_cast<u32>(glm::sqrt(glm::sqrt(TOLERANCE * deviationSq)));
+  glm::vec2 previous = p0;
+  for (u32 i = 1; i <= segments; ++i) {
+    const float t = static_cast<float>(i) / static_cast<float>(segments);
+    const glm::vec2 p = glm::mix(glm::mix(p0, p1, t), glm::mix(p1, p2, t), t);
+    linesOut.push_back({previous, p});
+    previous = p;
+  }
+}
+
+bool VKUIX::Font::outline(const u16 glyph, const Transform2D &transform, std::vector<Line> &linesOut, const u32 depth) const {
+  u32 start, end;
+  if (!glyphRange(glyph, start, end)) return false;
+  if (start == end) return true; // No outline
+
+  const int16_t contours = readI16(start);
+
+  // Composite: components with their own transform, each an outline of another glyph.
+  if (contours < 0) {
+    if (depth >= MAX_COMPOSITE_DEPTH) return false;
+    u32 cursor = start + 10;
+    u16 flags;
+    do {
+      if (cursor + 4 > end) return false;
+      flags = readU16(cursor);
+      const u16 component = readU16(cursor + 2);
+      cursor += 4;
+
+      glm::vec2 offset{0.0f};
+      if (flags & ARGS_ARE_WORDS) {
+        offset = {static_cast<float>(readI16(cursor)), static_cast<float>(readI16(cursor + 2))};
+        cursor += 4;
+      } else {
+        offset = {static_cast<float>(static_cast<int8_t>(readU8(cursor))), static_cast<float>(static_cast<int8_t>(readU8(cursor + 1)))};
+        cursor += 2;
+      }
+      // Anchoring by point numbers instead of offsets is not supported, the component is placed at its origin.
+      if (!(flags & ARGS_ARE_XY)) offset = glm::vec2{0.0f};
+
+      // F2Dot14 matrix, column major like glm.
+      const auto f2dot14 = [&](const u32 at) { return static_cast<float>(readI16(at)) / 16384.0f; };
+      glm::mat2 linear{1.0f};
+      if (flags & HAS_SCALE) {
+        linear[0][0] = linear[1][1] = f2dot14(cursor);
+        cursor += 2;
+      } else if (flags & HAS_XY_SCALE) {
+        linear[0][0] = f2dot14(cursor);
+        linear[1][1] = f2dot14(cursor + 2);
+        cursor += 4;
+      } else if (flags & HAS_2X2) {
+        linear[0][0] = f2dot14(cursor);
+        linear[0][1] = f2dot14(cursor + 2);
+        linear[1][0] = f2dot14(cursor + 4);
+        linear[1][1] = f2dot14(cursor + 6);
+        cursor += 8;
+      }
+
+      Transform2D nested{};
+      nested.linear = transform.linear * linear;
+      nested.offset = transform.apply(offset);
+      if (!outline(component, nested, linesOut, depth + 1)) return false;
+    } while (flags & MORE_COMPONENTS);
+    return true;
+  }
+
+  // Simple: contour end points, instructions, then run length encoded flags and delta encoded coordinates.
+  const u32 endPoints = start + 10;
+  const u32 pointCount = contours ? readU16(endPoints + 2 * (contours - 1)) + 1u : 0u;
+  u32 cursor = endPoints + 2 * contours;
+  cursor += 2 + readU16(cursor);
+
+  std::vector<u8> flags(pointCount);
+  for (u32 i = 0; i < pointCount;) {
+    if (cursor >= end) return false;
+    const u8 flag = readU8(cursor++);
+    flags[i++] = flag;
+    if (flag & REPEAT) {
+      for (u32 repeat = readU8(cursor++); repeat > 0 && i < pointCount; --repeat) flags[i++] = flag;
+    }
+  }
+
+  std::vector<glm::vec2> points(pointCount);
+  int value = 0;
+  for (u32 i = 0; i < pointCount; ++i) {
+    if (flags[i] & X_SHORT) {
+      const int delta = readU8(cursor++);
+      value += flags[i] & X_SAME_OR_POSITIVE ? delta : -delta;
+    } else if (!(flags[i] & X_SAME_OR_POSITIVE)) {
+      value += readI16(cursor);
+      cursor += 2;
+    }
+    points[i].x = static_cast<float>(value);
+  }
+  value = 0;
+  for (u32 i = 0; i < pointCount; ++i) {
+    if (flags[i] & Y_SHORT) {
+      const int delta = readU8(cursor++);
+      value += flags[i] & Y_SAME_OR_POSITIVE ? delta : -delta;
+    } else if (!(flags[i] & Y_SAME_OR_POSITIVE)) {
+      value += readI16(cursor);
+      cursor += 2;
+    }
+    points[i].y = static_cast<float>(value);
+  }
+  if (cursor > end) return false;
+
+  for (glm::vec2 &point : points) point = transform.apply(point);
+
+  // Consecutive off curve points have an implied on curve point halfway between them.
+  u32 first = 0;
+  for (int16_t c = 0; c < contours; ++c) {
+    const u32 last = readU16(endPoints + 2 * c);
+    if (last < first || last >= pointCount) return false;
+    const u32 count = last - first + 1;
+    const auto onCurve = [&](const u32 i) { return (flags[first + i] & ON_CURVE) != 0; };
+    const auto point = [&](const u32 i) { return points[first + i]; };
+
+    glm::vec2 begin;
+    if (onCurve(0)) begin = point(0);
+    else if (onCurve(count - 1)) begin = point(count - 1);
+    else begin = (point(0) + point(count - 1)) * 0.5f;
+
+    glm::vec2 current = begin;
+    glm::vec2 control{};
+    bool pendingControl = false;
+    for (u32 i = 0; i < count; ++i) {
+      const glm::vec2 p = point(i);
+      if (onCurve(i)) {
+        if (pendingControl) flattenQuad(current, control, p, linesOut);
+        else linesOut.push_back({current, p});
+        current = p;
+        pendingControl = false;
+      } else {
+        if (pendingControl) {
+          const glm::vec2 mid = (control + p) * 0.5f;
+          flattenQuad(current, control, mid, linesOut);
+          current = mid;
+        }
+        control = p;
+        pendingControl = true;
+      }
+    }
+    if (pendingControl) flattenQuad(current, control, begin, linesOut);
+    else linesOut.push_back({current, begin});
+
+    first = last + 1;
+  }
+  return true;
+}
+
+bool VKUIX::Font::rasterize(const u16 glyph, const float scale, Bitmap &out) const {
+  VKUIX_PROFILE_ZONE("Font::rasterize");
+  out = {};
+
+  Transform2D transform{};
+  transform.linear = glm::mat2{scale, 0.0f, 0.0f, -scale};
+  std::vector<Line> lines{};
+  if (!outline(glyph, transform, lines, 0)) return false;
+  if (lines.empty()) return true;
+
+  glm::vec2 minimum{FLT_MAX}, maximum{-FLT_MAX};
+  for (const Line &line : lines) {
+    minimum = glm::min(minimum, glm::min(line.p0, line.p1));
+    maximum = glm::max(maximum, glm::max(line.p0, line.p1));
+  }
+  out.x0 = static_cast<int>(glm::floor(minimum.x));
+  out.y0 = static_cast<int>(glm::floor(minimum.y));
+  out.width = static_cast<u32>(glm::ceil(maximum.x)) - out.x0;
+  out.height = static_cast<u32>(glm::ceil(maximum.y)) - out.y0;
+  if (out.width == 0 || out.height == 0) {
+    out.width = out.height = 0;
+    return true;
+  }
+
+  // Signed area accumulation: every line adds the coverage change it causes to the cells it crosses,
+  // a running sum over each row then gives the coverage. Rows are laid out back to back, what a line adds
+  // right of the last column lands at the start of the next row, where the running sum still needs it.
+  const u32 w = out.width;
+  const u32 h = out.height;
+  std::vector<float> accumulation(static_cast<size_t>(w) * h + 4, 0.0f);
+  const glm::vec2 origin{static_cast<float>(out.x0), static_cast<float>(out.y0)};
+
+  for (const Line &line : lines) {
+    glm::vec2 p0 = line.p0 - origin;
+    glm::vec2 p1 = line.p1 - origin;
+    if (p0.y == p1.y) continue;
+
+    float direction = 1.0f;
+    if (p0.y > p1.y) {
+      std::swap(p0, p1);
+      direction = -1.0f;
+    }
+    const float dxdy = (p1.x - p0.x) / (p1.y - p0.y);
+    float x = p0.x;
+    const u32 yEnd = glm::min(h, static_cast<u32>(glm::ceil(p1.y)));
+
+    for (u32 y = static_cast<u32>(p0.y); y < yEnd; ++y) {
+      const size_t row = static_cast<size_t>(y) * w;
+      const float dy = glm::min(static_cast<float>(y + 1), p1.y) - glm::max(static_cast<float>(y), p0.y);
+      const float xNext = x + dxdy * dy;
+      const float d = dy * direction;
+
+      const float x0 = glm::min(x, xNext);
+      const float x1 = glm::max(x, xNext);
+      const float x0Floor = glm::floor(x0);
+      const float x1Ceil = glm::ceil(x1);
+      const int x0i = glm::max(static_cast<int>(x0Floor), 0);
+      const int x1i = static_cast<int>(x1Ceil);
+
+      if (x1i <= x0i + 1) {
+        // Within one cell, split between it and the next by the mean x.
+        const float xMid = 0.5f * (x + xNext) - x0Floor;
+        accumulation[row + x0i] += d - d * xMid;
+        accumulation[row + x0i + 1] += d * xMid;
+      } else {
+        // Across several cells: the first and last get the triangles, the ones between equal shares.
+        const float s = 1.0f / (x1 - x0);
+        const float x0f = x0 - x0Floor;
+        const float a0 = 0.5f * s * (1.0f - x0f) * (1.0f - x0f);
+        const float x1f = x1 - x1Ceil + 1.0f;
+        const float am = 0.5f * s * x1f * x1f;
+
+        accumulation[row + x0i] += d * a0;
+        if (x1i == x0i + 2) {
+          accumulation[row + x0i + 1] += d * (1.0f - a0 - am);
+        } else {
+          const float a1 = s * (1.5f - x0f);
+          accumulation[row + x0i + 1] += d * (a1 - a0);
+          for (int xi = x0i + 2; xi < x1i - 1; ++xi) accumulation[row + xi] += d * s;
+          const float a2 = a1 + static_cast<float>(x1i - x0i - 3) * s;
+          accumulation[row + x1i - 1] += d * (1.0f - a2 - am);
+        }
+        accumulation[row + x1i] += d * am;
+      }
+      x = xNext;
+    }
+  }
+
+  // Non-zero winding, coverage saturates at 1.
+  out.coverage.resize(static_cast<size_t>(w) * h);
+  float sum = 0.0f;
+  for (size_t i = 0; i < out.coverage.size(); ++i) {
+    sum += accumulation[i];
+    out.coverage[i] = static_cast<u8>(glm::min(glm::abs(sum), 1.0f) * 255.0f + 0.5f);
+  }
+  return true;
+}
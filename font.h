@@ -0,0 +1,75 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "common.h"
+
+namespace VKUIX {
+
+  // TrueType font with quadratic glyf outlines. Parses only what laying out and rasterizing text needs:
+  // head, hhea, maxp, hmtx, loca, glyf including composite glyphs, and cmap formats 4 and 12.
+  // CFF based OpenType fonts are rejected.
+  class Font {
+  public:
+    // Takes the whole font file. Returns false if it is not a font this parser understands.
+    bool load(std::vector<u8> fileData);
+    bool loadFile(const std::string &path);
+
+    // 0, the missing glyph, if the font does not map the codepoint.
+    [[nodiscard]] u16 glyphIndex(u32 codepoint) const;
+
+    // Pixels per font unit for a font size in pixels per em.
+    [[nodiscard]] float scaleForSize(float pixelSize) const;
+    // In font units.
+    [[nodiscard]] float getAdvance(u16 glyph) const;
+    [[nodiscard]] float getAscent() const;
+    [[nodiscard]] float getDescent() const; // Negative below the baseline
+    [[nodiscard]] float getLineGap() const;
+
+    // 8 bit coverage of one glyph, rows top to bottom.
+    struct Bitmap {
+      int x0{0}; // Top left corner relative to the pen position on the baseline, y down
+      int y0{0};
+      u32 width{0};
+      u32 height{0};
+      std::vector<u8> coverage{};
+    };
+    // Rasterizes the outline with exact area coverage. Glyphs without an outline, like space, give an empty bitmap.
+    // Returns false if the glyph data is malformed.
+    bool rasterize(u16 glyph, float scale, Bitmap &out) const;
+
+  private:
+    struct Line {
+      glm::vec2 p0, p1;
+    };
+    // Font units to pixels, y down. Composite glyphs nest their component transforms into it.
+    struct Transform2D {
+      glm::mat2 linear{1.0f};
+      glm::vec2 offset{0.0f};
+      [[nodiscard]] glm::vec2 apply(const glm::vec2 p) const { return linear * p + offset; }
+    };
+
+    std::vector<u8> data{};
+    u32 glyf{0}, loca{0}, hmtx{0}, cmap{0}; // Table offsets, cmap points at the chosen subtable
+    u16 cmapFormat{0};
+    u16 unitsPerEm{0};
+    bool longLoca{false};
+    u16 numGlyphs{0};
+    u16 numHMetrics{0};
+    float ascent{0.0f}, descent{0.0f}, lineGap{0.0f};
+
+    [[nodiscard]] u8 readU8(u32 offset) const;
+    [[nodiscard]] u16 readU16(u32 offset) const;
+    [[nodiscard]] int16_t readI16(u32 offset) const;
+    [[nodiscard]] u32 readU32(u32 offset) const;
+    [[nodiscard]] u32 findTable(const char *tag) const;
+    // Byte range of a glyph in glyf, empty for glyphs without an outline.
+    bool glyphRange(u16 glyph, u32 &startOut, u32 &endOut) const;
+
+    // Appends the outline of glyph as flattened lines in pixel space.
+    bool outline(u16 glyph, const Transform2D &transform, std::vector<Line> &linesOut, u32 depth) const;
+    static void flattenQuad(glm::vec2 p0, glm::vec2 p1, glm::vec2 p2, std::vector<Line> &linesOut);
+  };
+
+}
@@ -0,0 +1,229 @@
+#include "glyph_atlas.h"
+
+#include <cstring>
+
+#include "profiler.h"
+
+// Font sizes are cached in quarter pixel steps.
+static constexpr float SIZE_STEPS = 4.0f;
+
+static VkRect2D unionRect(const VkRect2D &a, const VkRect2D &b) {
+  if (a.extent.width == 0 || a.extent.height == 0) return b;
+  const int32_t x0 = glm::min(a.offset.x, b.offset.x);
+  const int32_t y0 = glm::min(a.offset.y, b.offset.y);
+  const int32_t x1 = glm::max(a.offset.x + static_cast<int32_t>(a.extent.width), b.offset.x + static_cast<int32_t>(b.extent.width));
+  const int32_t y1 = glm::max(a.offset.y + static_cast<int32_t>(a.extent.height), b.offset.y + static_cast<int32_t>(b.extent.height));
+  return {{x0, y0}, {static_cast<u32>(x1 - x0), static_cast<u32>(y1 - y0)}};
+}
+
+VKUIX::GlyphAtlas::GlyphAtlas() : pixels(static_cast<size_t>(SIZE) * SIZE, 0), bands(BAND_COUNT) {
+  for (u32 b = 0; b < BAND_COUNT; ++b) resetBand(b);
+  generation = 0;
+}
+
+VKUIX::FontId VKUIX::GlyphAtlas::addFont(Font &&font) {
+  std::lock_guard guard{mutex};
+  if (fonts.size() >= INVALID_FONT) return INVALID_FONT;
+  fonts.push_back(std::make_unique<Font>(std::move(font)));
+  return static_cast<FontId>(fonts.size() - 1);
+}
+
+const VKUIX::Font *VKUIX::GlyphAtlas::getFont(const FontId font) const {
+  return font < fonts.size() ? fonts[font].get() : nullptr;
+}
+
+std::unique_lock<std::mutex> VKUIX::GlyphAtlas::lock() {
+  return std::unique_lock{mutex};
+}
+
+u64 VKUIX::GlyphAtlas::key(const FontId font, const u32 codepoint, const float pixelSize) {
+  const u64 size = static_cast<u64>(glm::clamp(glm::round(pixelSize * SIZE_STEPS), 1.0f, 65535.0f));
+  return static_cast<u64>(font) << 48 | size << 32 | codepoint;
+}
+
+int VKUIX::GlyphAtlas::skylineFits(const Band &band, u32 node, const u16 width, const u16 height) {
+  if (band.skyline[node].x + width > SIZE) return -1;
+  int y = band.skyline[node].y;
+  int spaceLeft = width;
+  while (spaceLeft > 0) {
+    if (node == band.skyline.size()) return -1;
+    y = glm::max<int>(y, band.skyline[node].y);
+    if (y + height > static_cast<int>(BAND_HEIGHT)) return -1;
+    spaceLeft -= band.skyline[node].width;
+    ++node;
+  }
+  return y;
+}
+
+bool VKUIX::GlyphAtlas::pack(Band &band, const u16 width, const u16 height, u16 &xOut, u16 &yOut) {
+  // Lowest top edge wins, ties go to the narrower node so wide gaps stay free for wide glyphs.
+  int bestTop = BAND_HEIGHT + 1, bestWidth = SIZE + 1, bestNode = -1;
+  for (u32 i = 0; i < band.skyline.size(); ++i) {
+    const int y = skylineFits(band, i, width, height);
+    if (y < 0) continue;
+    if (y + height < bestTop || (y + height == bestTop && band.skyline[i].width < bestWidth)) {
+      bestNode = static_cast<int>(i);
+      bestTop = y + height;
+      bestWidth = band.skyline[i].width;
+      xOut = band.skyline[i].x;
+      yOut = static_cast<u16>(y);
+    }
+  }
+  if (bestNode < 0) return false;
+
+  std::vector<SkylineNode> &skyline = band.skyline;
+  skyline.insert(skyline.begin() + bestNode, {xOut, static_cast<u16>(bestTop), width});
+
+  // Nodes now under the new one shrink or go away.
+  for (size_t i = bestNode + 1; i < skyline.size(); ++i) {
+    const int previousEnd = skyline[i - 1].x + skyline[i - 1].width;
+    if (skyline[i].x >= previousEnd) break;
+    const int shrink = previousEnd - skyline[i].x;
+    if (skyline[i].width <= shrink) {
+      skyline.erase(skyline.begin() + static_cast<std::ptrdiff_t>(i));
+      --i;
+      continue;
+    }
+    skyline[i].x = static_cast<u16>(skyline[i].x + shrink);
+    skyline[i].width = static_cast<u16>(skyline[i].width - shrink);
+    break;
+  }
+
+  // Neighbours at the same height merge.
+  for (size_t i = 0; i + 1 < skyline.size(); ++i) {
+    if (skyline[i].y != skyline[i + 1].y) continue;
+    skyline[i].width = static_cast<u16>(skyline[i].width + skyline[i + 1].width);
+    skyline.erase(skyline.begin() + static_cast<std::ptrdiff_t>(i) + 1);
+    --i;
+  }
+  return true;
+}
+
+void VKUIX::GlyphAtlas::resetBand(const u32 band) {
+  Band &b = bands[band];
+  for (const u64 cached : b.keys) glyphs.erase(cached);
+  b.keys.clear();
+  b.skyline = {{0, 0, static_cast<u16>(SIZE)}};
+  b.lastUsed = 0;
+  generation++;
+}
+
+void VKUIX::GlyphAtlas::markDirty(Band &band, const VkRect2D &rect) {
+  band.dirty = unionRect(band.dirty, rect);
+}
+
+const VKUIX::GlyphAtlas::Glyph *VKUIX::GlyphAtlas::glyph(const FontId font, const u32 codepoint, const float pixelSize) {
+  const u64 glyphKey = key(font, codepoint, pixelSize);
+  if (const auto cached = glyphs.find(glyphKey); cached != glyphs.end()) {
+    if (cached->second.band != NO_BAND) bands[cached->second.band].lastUsed = frame;
+    stats.hits++;
+    return &cached->second;
+  }
+
+  const Font *source = getFont(font);
+  if (!source) return nullptr;
+  VKUIX_PROFILE_ZONE("GlyphAtlas::miss");
+  stats.misses++;
+
+  // Rasterized at the cached size, so every size within a step looks the same.
+  const float size = static_cast<float>(glyphKey >> 32 & 0xFFFF) / SIZE_STEPS;
+  const float scale = source->scaleForSize(size);
+  const u16 index = source->glyphIndex(codepoint);
+  Font::Bitmap bitmap{};
+  if (!source->rasterize(index, scale, bitmap)) {
+    LOG_FIRST(W, 4, "Glyph " << index << " of font " << font << " is malformed, drawing it empty.");
+    bitmap = {};
+  }
+
+  Glyph glyph{};
+  glyph.advance = source->getAdvance(index) * scale;
+  glyph.offsetX = static_cast<int16_t>(bitmap.x0);
+  glyph.offsetY = static_cast<int16_t>(bitmap.y0);
+  glyph.band = NO_BAND;
+
+  if (bitmap.width > 0) {
+    const u32 paddedWidth = bitmap.width + 2 * PADDING;
+    const u32 paddedHeight = bitmap.height + 2 * PADDING;
+    if (paddedWidth > SIZE || paddedHeight > BAND_HEIGHT) {
+      LOG_FIRST(W, 1, "Glyphs at " << size << " px are too large for the glyph atlas.");
+      stats.failures++;
+      return nullptr;
+    }
+
+    u16 x = 0, y = 0;
+    u32 band = 0;
+    while (band < BAND_COUNT && !pack(bands[band], paddedWidth, paddedHeight, x, y)) ++band;
+
+    if (band == BAND_COUNT) {
+      // Every band is full, empty the least recently used one this frame does not draw from.
+      u32 victim = BAND_COUNT;
+      for (u32 b = 0; b < BAND_COUNT; ++b) {
+        if (bands[b].lastUsed >= frame) continue;
+        if (victim == BAND_COUNT || bands[b].lastUsed < bands[victim].lastUsed) victim = b;
+      }
+      if (victim == BAND_COUNT) {
+        LOG_FIRST(W, 1, "Glyph atlas is full with glyphs of the current frame, skipping glyphs.");
+        stats.failures++;
+        return nullptr;
+      }
+      resetBand(victim);
+      stats.evictions++;
+      band = victim;
+      pack(bands[band], paddedWidth, paddedHeight, x, y);
+    }
+
+    // The padding is cleared as well, evicted glyphs may have left coverage there.
+    const u32 top = band * BAND_HEIGHT + y;
+    for (u32 row = 0; row < paddedHeight; ++row)
+      memset(pixels.data() + static_cast<size_t>(top + row) * SIZE + x, 0, paddedWidth);
+    for (u32 row = 0; row < bitmap.height; ++row)
+      memcpy(pixels.data() + static_cast<size_t>(top + PADDING + row) * SIZE + x + PADDING,
+             bitmap.coverage.data() + static_cast<size_t>(row) * bitmap.width, bitmap.width);
+
+    Band &target = bands[band];
+    markDirty(target, {{static_cast<int32_t>(x), static_cast<int32_t>(top)}, {paddedWidth, paddedHeight}});
+    target.keys.push_back(glyphKey);
+    target.lastUsed = frame;
+
+    glyph.x = static_cast<u16>(x + PADDING);
+    glyph.y = static_cast<u16>(top + PADDING);
+    glyph.width = static_cast<u16>(bitmap.width);
+    glyph.height = static_cast<u16>(bitmap.height);
+    glyph.band = static_cast<u8>(band);
+  }
+
+  return &glyphs.emplace(glyphKey, glyph).first->second;
+}
+
+u32 VKUIX::GlyphAtlas::getGeneration() const {
+  return generation;
+}
+
+void VKUIX::GlyphAtlas::takeDirty(std::vector<VkRect2D> &rectsOut) {
+  std::lock_guard guard{mutex};
+  rectsOut.clear();
+  if (!uploaded) {
+    rectsOut.push_back({{0, 0}, {SIZE, SIZE}});
+    uploaded = true;
+    for (Band &band : bands) band.dirty = {};
+    return;
+  }
+  for (Band &band : bands) {
+    if (band.dirty.extent.width == 0) continue;
+    rectsOut.push_back(band.dirty);
+    band.dirty = {};
+  }
+}
+
+const u8 *VKUIX::GlyphAtlas::getPixels() const {
+  return pixels.data();
+}
+
+void VKUIX::GlyphAtlas::nextFrame() {
+  std::lock_guard guard{mutex};
+  frame++;
+}
+
+VKUIX::GlyphAtlas::Stats VKUIX::GlyphAtlas::getStats() const {
+  return stats;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <mutex>
+#include <unordered_map>
+
+#include "vulkan/vulkan.h"
+
+#include "font.h"
+
+namespace VKUIX {
+
+  using FontId = u16;
+  inline constexpr FontId INVALID_FONT = UINT16_MAX;
+
+  // Glyphs rasterized on first use into one R8 coverage texture shared by all text.
+  // The atlas is split into horizontal bands, each packed with its own skyline. When no band has room,
+  // the least recently used band is emptied and packed again. Bands used by the current frame are never evicted,
+  // earlier frames are safe because the upload waits for their sampling, see recordAtlasUpload in vkuix.cpp.
+  // Only the CPU copy lives here, the renderer uploads the rects returned by takeDirty.
+  class GlyphAtlas {
+  public:
+    static constexpr u32 SIZE = 1024;
+    static constexpr u32 BAND_HEIGHT = 128;
+    static constexpr u32 BAND_COUNT = SIZE / BAND_HEIGHT;
+    static constexpr u32 PADDING = 1; // Empty texels around every glyph, so bilinear filtering never bleeds
+
+    GlyphAtlas();
+
+    // Fonts live as long as the atlas. Returns INVALID_FONT once UINT16_MAX fonts are loaded.
+    FontId addFont(Font &&font);
+    [[nodiscard]] const Font *getFont(FontId font) const;
+
+    struct Glyph {
+      u16 x, y, width, height; // Coverage in the atlas, without padding
+      int16_t offsetX, offsetY; // Top left of the coverage relative to the pen position on the baseline
+      float advance; // Pixels
+      u8 band; // NO_BAND for glyphs without coverage
+    };
+    static constexpr u8 NO_BAND = UINT8_MAX;
+
+    // Lookups and rasterization may happen on any thread, but have to hold this lock.
+    [[nodiscard]] std::unique_lock<std::mutex> lock();
+    // Returns the glyph of codepoint at pixelSize, rasterizing and packing it on a miss.
+    // Null if it does not fit into a band or every band is still in use. Valid until the lock is released.
+    const Glyph *glyph(FontId font, u32 codepoint, float pixelSize);
+
+    // Bumped whenever a band is evicted, which may move glyphs that were cached before.
+    [[nodiscard]] u32 getGeneration() const;
+
+    // Moves the rects changed since the last call into rectsOut, at most one per band. The first call
+    // returns the whole atlas. Called by the render thread while no RenderList is being filled.
+    void takeDirty(std::vector<VkRect2D> &rectsOut);
+    // SIZE * SIZE coverage texels, rows top to bottom.
+    [[nodiscard]] const u8 *getPixels() const;
+    // Marks the end of a frame for eviction.
+    void nextFrame();
+
+    struct Stats {
+      u64 hits{0};
+      u64 misses{0}; // Glyphs rasterized
+      u64 evictions{0}; // Bands emptied
+      u64 failures{0}; // Glyphs that could not be packed
+    };
+    [[nodiscard]] Stats getStats() const;
+
+  private:
+    struct SkylineNode {
+      u16 x, y, width; // y is relative to the band
+    };
+    struct Band {
+      std::vector<SkylineNode> skyline{};
+      std::vector<u64> keys{}; // Cached glyphs packed into this band
+      u64 lastUsed{0};
+      VkRect2D dirty{};
+    };
+
+    std::mutex mutex{};
+    std::vector<u8> pixels;
+    std::vector<uptr<Font>> fonts{};
+    std::unordered_map<u64, Glyph> glyphs{};
+    std::vector<Band> bands{};
+    u64 frame{1}; // Band::lastUsed 0 means never used
+    u32 generation{0};
+    bool uploaded{false};
+    Stats stats{};
+
+    static u64 key(FontId font, u32 codepoint, float pixelSize);
+    // Skyline bottom-left packing within one band. Returns false if the rect does not fit.
+    static bool pack(Band &band, u16 width, u16 height, u16 &xOut, u16 &yOut);
+    static int skylineFits(const Band &band, u32 node, u16 width, u16 height);
+    void resetBand(u32 band);
+    void markDirty(Band &band, const VkRect2D &rect);
+  };
+
+}
@@ -10,6 +10,11 @@ struct Image {
   VkFormat format;
   VkSampleCountFlagBits sampleCount = VK_SAMPLE_COUNT_1_BIT;
   VkImageUsageFlags usageFlags = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+  VkComponentMapping swizzle{}; // Of the view, identity by default
+  bool uploadTarget{false}; // Written through VKUIX::UploadManager, shared with its transfer queue
+  // Attachment that is never loaded or stored, like an MSAA target that is only resolved. Backed by lazily
+  // allocated memory where the device has it, so tilers can keep it in tile memory.
+  bool transient{false};
 
   VmaAllocation alloc{};
 };
\ No newline at end of file
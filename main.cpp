@@ -1,19 +1,41 @@
 #include "vkuix.h"
+#include "profiler.h"
 
 int main() {
+  VKUIX_PROFILE_THREAD("main");
 
   const sptr<VKUIX::Window> window = VKUIX::createWindow("VKUIX", VKUIX::Dim{1050, 600});
   const sptr<VKUIX::Instance> instance = VKUIX::createInstance(window);
+  VKUIX::setMaxQueuedFrames(instance, 1);
 
   window->show();
 
   while (!glfwWindowShouldClose(window->getWindowPtr())) {
+    VKUIX::waitForFrameLatency(instance);
     glfwPollEvents();
 
-    const uptr<VKUIX::RenderList> &renderList = VKUIX::getRenderList(instance);
-    renderList->roundRect(10, 10, window->getExtent().width - 20, 50, {5}, 2, VKUIX::Color(41, 41, 43, 255));
-    renderList->roundRect(10, 70, 250, 450, {5}, 2, VKUIX::Color(41, 41, 41, 255));
+    {
+      VKUIX_PROFILE_ZONE("buildRenderList");
+      const uptr<VKUIX::RenderList> &renderList = VKUIX::getRenderList(instance);
+      renderList->roundRect(10, 10, window->getExtent().width - 20, 50, {5}, VKUIX::Color(41, 41, 43, 255));
+      renderList->roundRect(10, 70, 250, 450, {5}, VKUIX::Color(41, 41, 41, 255));
+    }
 
     VKUIX::render(instance, window);
+
+    const VKUIX::FrameStats &stats = VKUIX::getFrameStats(instance);
+    LOG_TIMED(I, 5, "GPU frame " << stats.gpuFrameMs << " ms, draws " << stats.gpuDrawMs << " ms, clear and resolve "
+                                 << stats.gpuAttachmentMs << " ms, overdraw " << stats.overdraw << ", input to submit "
+                                 << stats.inputToSubmitMs << " ms, submit to present " << stats.submitToPresentMs << " ms");
+
+#ifdef VKUIX_PROFILING
+    // F12 dumps everything recorded so far.
+    static bool dumpHeld = false;
+    const bool dumpPressed = glfwGetKey(window->getWindowPtr(), GLFW_KEY_F12) == GLFW_PRESS;
+    if (dumpPressed && !dumpHeld) VKUIX_PROFILE_DUMP("vkuix_trace.json");
+    dumpHeld = dumpPressed;
+#endif
   }
+
+  VKUIX::destroyInstance(instance);
 }
\ No newline at end of file
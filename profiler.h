@@ -0,0 +1,145 @@
+#pragma once
+
+// Scoped CPU zone profiler with Chrome trace-event export (chrome://tracing, ui.perfetto.dev).
+//
+//   VKUIX_PROFILE_ZONE("render.acquire");   // Measures until the end of the enclosing scope
+//   VKUIX_PROFILE_THREAD("worker 1");        // Names the calling thread in the trace
+//   VKUIX_PROFILE_DUMP("trace.json");        // Writes everything recorded so far
+//
+// Only active when built with VKUIX_PROFILING, otherwise every macro expands to nothing.
+// Zone names must be string literals, only the pointer is stored.
+
+#ifdef VKUIX_PROFILING
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "common.h"
+
+namespace VKUIX::Profiler {
+
+  struct Zone {
+    const char *name;
+    int64_t start; // ns since the profiler epoch
+    int64_t end;
+  };
+
+  // Zones of one thread. Only the owning thread writes, so recording needs no lock: the zone is written first,
+  // then published by a release store of head. Once full, the oldest zones are overwritten.
+  struct ThreadRing {
+    static constexpr u32 CAPACITY = 1u << 16;
+
+    std::array<Zone, CAPACITY> zones{};
+    std::atomic<u64> head{0};
+    u32 threadId{0};
+    std::string threadName{};
+  };
+
+  struct Registry {
+    std::mutex mutex{};
+    std::vector<std::shared_ptr<ThreadRing>> rings{}; // Kept alive after their thread exits
+  };
+
+  inline Registry &registry() {
+    static Registry instance{};
+    return instance;
+  }
+
+  inline int64_t now() {
+    static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+  }
+
+  // Registers the calling thread on first use. After that it is a plain thread local access.
+  inline ThreadRing &threadRing() {
+    thread_local ThreadRing *ring = [] {
+      const auto created = std::make_shared<ThreadRing>();
+      Registry &reg = registry();
+      std::lock_guard lock{reg.mutex};
+      created->threadId = reg.rings.size();
+      created->threadName = "thread " + std::to_string(created->threadId);
+      reg.rings.push_back(created);
+      return created.get();
+    }();
+    return *ring;
+  }
+
+  inline void setThreadName(const char *name) {
+    ThreadRing &ring = threadRing();
+    std::lock_guard lock{registry().mutex};
+    ring.threadName = name;
+  }
+
+  class ScopedZone {
+  public:
+    explicit ScopedZone(const char *name) : name(name), start(now()) {}
+    ~ScopedZone() {
+      ThreadRing &ring = threadRing();
+      const u64 head = ring.head.load(std::memory_order_relaxed);
+      ring.zones[head % ThreadRing::CAPACITY] = {name, start, now()};
+      ring.head.store(head + 1, std::memory_order_release);
+    }
+
+    ScopedZone(const ScopedZone &) = delete;
+    ScopedZone &operator=(const ScopedZone &) = delete;
+
+  private:
+    const char *name;
+    int64_t start;
+  };
+
+  // Writes the zones of every thread as Chrome trace-event JSON. Threads keep recording meanwhile,
+  // zones they overwrite during the dump may show up torn, so dump between frames.
+  inline bool writeChromeTrace(const std::string &path) {
+    std::ofstream out{path};
+    if (!out) {
+      LOG(W, "Could not open " << path << " for the profiler trace.");
+      return false;
+    }
+
+    Registry &reg = registry();
+    std::lock_guard lock{reg.mutex};
+
+    out << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n";
+    bool first = true;
+    for (const std::shared_ptr<ThreadRing> &ring : reg.rings) {
+      out << (first ? "" : ",\n") << R"({"name": "thread_name", "ph": "M", "pid": 0, "tid": )" << ring->threadId
+          << R"(, "args": {"name": ")" << ring->threadName << "\"}}";
+      first = false;
+
+      const u64 head = ring->head.load(std::memory_order_acquire);
+      const u64 begin = head > ThreadRing::CAPACITY ? head - ThreadRing::CAPACITY : 0;
+      for (u64 i = begin; i < head; ++i) {
+        const Zone &zone = ring->zones[i % ThreadRing::CAPACITY];
+        out << ",\n" << R"({"name": ")" << zone.name << R"(", "ph": "X", "pid": 0, "tid": )" << ring->threadId
+            << ", \"ts\": " << static_cast<double>(zone.start) / 1000.0
+            << ", \"dur\": " << static_cast<double>(zone.end - zone.start) / 1000.0 << "}";
+      }
+    }
+    out << "\n]}\n";
+
+    LOG(I, "Wrote profiler trace to " << path);
+    return true;
+  }
+
+} // namespace VKUIX::Profiler
+
+#define VKUIX_PROFILE_CONCAT_INNER(A, B) A##B
+#define VKUIX_PROFILE_CONCAT(A, B) VKUIX_PROFILE_CONCAT_INNER(A, B)
+
+#define VKUIX_PROFILE_ZONE(name) const VKUIX::Profiler::ScopedZone VKUIX_PROFILE_CONCAT(vkuixZone, __LINE__){name}
+#define VKUIX_PROFILE_THREAD(name) VKUIX::Profiler::setThreadName(name)
+#define VKUIX_PROFILE_DUMP(path) VKUIX::Profiler::writeChromeTrace(path)
+
+#else
+
+#define VKUIX_PROFILE_ZONE(name) ((void)0)
+#define VKUIX_PROFILE_THREAD(name) ((void)0)
+#define VKUIX_PROFILE_DUMP(path) ((void)0)
+
+#endif
@@ -1,124 +1,505 @@
 #include "renderlist.h"
 
+#include <bit>
+#include <cfloat>
+#include <cstring>
+
 #include <glm/ext/scalar_constants.hpp>
 #include <glm/gtc/constants.hpp>
 
-void VKUIX::RenderList::rect(float x, float y, const float w, const float h, Color c) {
-  std::vector<VkBackend::Vertex> rectVertices = {
-      {{x, y}, c.glmDecimal()},
-      {{x + w, y}, c.glmDecimal()},
-      {{x + w, y + h}, c.glmDecimal()},
+// Opcodes that start every hashed call, so different calls with equal arguments hash differently.
+enum HashOp : u32 {
+  OP_RECT = 1,
+  OP_ROUND_RECT,
+  OP_ROUND_RECT_MESH,
+  OP_PUSH_CLIP,
+  OP_POP_CLIP,
+  OP_LAYER,
+  OP_VIEWPORT,
+  OP_TEXT,
+  OP_IMAGE,
+};
 
-      {{x, y}, c.glmDecimal()},
-      {{x + w, y + h}, c.glmDecimal()},
-      {{x, y + h}, c.glmDecimal()},
-  };
-  vertices.insert(vertices.end(), rectVertices.begin(), rectVertices.end());
+u64 VKUIX::RenderList::mix(u64 seed, const std::initializer_list<u32> words) {
+  // Multiply-rotate mix in the style of FxHash. Not collision resistant, only cheap.
+  for (const u32 word : words)
+    seed = (std::rotl(seed, 5) ^ word) * 0x517cc1b727220a95ull;
+  return seed;
+}
+
+u64 VKUIX::RenderList::hashWords(const std::initializer_list<u32> words) {
+  const u64 callHash = mix(HASH_SEED, words);
+  hash = mix(hash, {static_cast<u32>(callHash), static_cast<u32>(callHash >> 32)});
+  return callHash;
+}
+
+void VKUIX::RenderList::damage(const u64 callHash, float x0, float y0, float x1, float y1) {
+  if (!clipStack.empty()) {
+    const ClipRect &top = clipStack.back();
+    x0 = glm::max(x0, top.x0);
+    y0 = glm::max(y0, top.y0);
+    x1 = glm::min(x1, top.x1);
+    y1 = glm::min(y1, top.y1);
+  }
+  damageRecords.push_back({mix(callHash, {layer, bits(x0), bits(y0), bits(x1), bits(y1)}), x0, y0, x1, y1});
+}
+
+u32 VKUIX::RenderList::bits(const float value) {
+  return std::bit_cast<u32>(value);
+}
+
+bool VKUIX::RenderList::clip(const float x0, const float y0, const float x1, const float y1, u16 &scissorOut) {
+  scissorOut = 0;
+  if (clipStack.empty()) return true;
+
+  const ClipRect &top = clipStack.back();
+  if (x1 <= top.x0 || x0 >= top.x1 || y1 <= top.y0 || y0 >= top.y1) {
+    culled++;
+    return false;
+  }
+  if (x0 < top.x0 || y0 < top.y0 || x1 > top.x1 || y1 > top.y1)
+    scissorOut = top.scissor;
+  return true;
+}
+
+VKUIX::DrawCmd &VKUIX::RenderList::command(const PipelineId pipeline, const u16 scissor, const bool opaque, const u32 vertexCount) {
+  const u64 key = DrawCmd::makeKey(layer, pipeline, scissor);
+  if (!commands.empty()) {
+    DrawCmd &last = commands.back();
+    if (last.key == key && last.opaque == opaque && (pipeline != PipelineId::Triangles || last.count + vertexCount <= MAX_BATCH_VERTICES))
+      return last;
+  }
+
+  DrawCmd cmd{};
+  cmd.key = key;
+  cmd.pipeline = pipeline;
+  cmd.layer = layer;
+  cmd.scissor = scissor;
+  cmd.opaque = opaque;
+  switch (pipeline) {
+    case PipelineId::Triangles: cmd.first = vertices.size(); break;
+    case PipelineId::RoundRect: cmd.first = rects.size(); break;
+    case PipelineId::Textured: cmd.first = textured.size(); break;
+  }
+  cmd.firstIndex = indices.size();
+  commands.push_back(cmd);
+  return commands.back();
+}
+
+u32 VKUIX::RenderList::beginPrimitive(const u16 scissor, const bool opaque, const u32 vertexCount) {
+  DrawCmd &cmd = command(PipelineId::Triangles, scissor, opaque, vertexCount);
+  const u32 base = cmd.count;
+  cmd.count += vertexCount;
+  return base;
+}
+
+void VKUIX::RenderList::quad(const u32 a, const u32 b, const u32 c, const u32 d) {
+  indices.insert(indices.end(), {a, b, c, a, c, d});
+  commands.back().indexCount += 6;
+}
+
+void VKUIX::RenderList::rect(float x, float y, float w, float h, Color c) {
+  const u64 callHash = hashWords({OP_RECT, bits(x), bits(y), bits(w), bits(h), c.packed()});
+
+  u16 scissor;
+  if (!clip(x, y, x + w, y + h, scissor)) return;
+  damage(callHash, x, y, x + w, y + h);
+
+  // Axis aligned, so trimming to the clip is exact and the rect never needs a scissor.
+  if (scissor != 0) {
+    const ClipRect &top = clipStack.back();
+    const float x1 = glm::min(x + w, top.x1);
+    const float y1 = glm::min(y + h, top.y1);
+    x = glm::max(x, top.x0);
+    y = glm::max(y, top.y0);
+    w = x1 - x;
+    h = y1 - y;
+    scissor = 0;
+  }
+
+  const u32 base = beginPrimitive(scissor, c.a() == 255, 4);
+
+  vertices.push_back({{x, y}, c});
+  vertices.push_back({{x + w, y}, c});
+  vertices.push_back({{x + w, y + h}, c});
+  vertices.push_back({{x, y + h}, c});
+
+  quad(base, base + 1, base + 2, base + 3);
 }
 
-void VKUIX::RenderList::roundRect(float x, float y, float w, float h, BorderRadius radis, int subdiv, Color c) {
+void VKUIX::RenderList::roundRect(const float x, const float y, const float w, const float h, const BorderRadius radis, const Color c,
+                                  const float borderWidth, const Color borderColor) {
+  const u64 callHash = hashWords({OP_ROUND_RECT, bits(x), bits(y), bits(w), bits(h),
+                                  bits(radis.topLeft), bits(radis.topRight), bits(radis.bottomLeft), bits(radis.bottomRight),
+                                  c.packed(), bits(borderWidth), borderColor.packed()});
+
+  // The quad is padded for antialiasing in roundrect.vert.
+  u16 scissor;
+  if (!clip(x - 1.0f, y - 1.0f, x + w + 1.0f, y + h + 1.0f, scissor)) return;
+  damage(callHash, x - 1.0f, y - 1.0f, x + w + 1.0f, y + h + 1.0f);
+
+  // Radii are clamped to half the smaller dimension in roundrect.vert.
+  VkBackend::RectInstance rect{};
+  rect.bounds = {x, y, w, h};
+  rect.radii = {radis.topLeft, radis.topRight, radis.bottomLeft, radis.bottomRight};
+  rect.color = c;
+  rect.borderColor = borderColor;
+  rect.borderWidth = borderWidth;
+  // Only the fully covered interior is drawn in the opaque pass, so the edge may be antialiased.
+  const bool opaque = c.a() == 255 && (borderWidth <= 0.0f || borderColor.a() == 255);
+  command(PipelineId::RoundRect, scissor, opaque).count++;
+  rects.push_back(rect);
+}
+
+void VKUIX::RenderList::roundRectMesh(float x, float y, float w, float h, BorderRadius radis, int subdiv, Color c) {
+  const u64 callHash = hashWords({OP_ROUND_RECT_MESH, bits(x), bits(y), bits(w), bits(h),
+                                  bits(radis.topLeft), bits(radis.topRight), bits(radis.bottomLeft), bits(radis.bottomRight),
+                                  static_cast<u32>(subdiv), c.packed()});
+
+  u16 scissor;
+  if (!clip(x, y, x + w, y + h, scissor)) return;
+  damage(callHash, x, y, x + w, y + h);
+
+  subdiv = glm::max(subdiv, 1);
+
   // Ensure corner radius doesn't exceed half the smaller dimension
   radis.topLeft = glm::min(radis.topLeft, glm::min(w, h) / 2.0f);
   radis.topRight = glm::min(radis.topRight, glm::min(w, h) / 2.0f);
   radis.bottomLeft = glm::min(radis.bottomLeft, glm::min(w, h) / 2.0f);
   radis.bottomRight = glm::min(radis.bottomRight, glm::min(w, h) / 2.0f);
 
-  const glm::vec4 col = c.glmDecimal();
-
   // Calculate bounds
-  float left = x;
-  float right = x + w;
-  float bottom = y;
-  float top = y + h;
-
-  // Calculate inner rectangle bounds (where corners start)
-  float innerLeft = left + radis.topLeft;
-  float innerRight = right - radis.topRight;
-  float innerBottom = bottom + radis.bottomLeft;
-  float innerTop = top - radis.topLeft;
-
-  // Define corner centers and angle ranges
+  const float left = x;
+  const float right = x + w;
+  const float bottom = y;
+  const float top = y + h;
+
+  // Define corner centers, radii and angle ranges
   struct Corner {
     glm::vec2 center;
+    float radius;
     float startAngle;
   };
 
-  Corner corners[4] = {
-      {{innerLeft, innerBottom}, glm::pi<float>()}, // Bottom-left
-      {{innerRight, innerBottom}, glm::pi<float>() * 1.5f}, // Bottom-right
-      {{innerRight, innerTop}, 0.0f}, // Top-right
-      {{innerLeft, innerTop}, glm::pi<float>() * 0.5f} // Top-left
+  const Corner corners[4] = {
+      {{left + radis.bottomLeft, bottom + radis.bottomLeft}, radis.bottomLeft, glm::pi<float>()}, // Bottom-left
+      {{right - radis.bottomRight, bottom + radis.bottomRight}, radis.bottomRight, glm::pi<float>() * 1.5f}, // Bottom-right
+      {{right - radis.topRight, top - radis.topRight}, radis.topRight, 0.0f}, // Top-right
+      {{left + radis.topLeft, top - radis.topLeft}, radis.topLeft, glm::pi<float>() * 0.5f} // Top-left
   };
 
-  // Generate corner arcs using triangles
-  for (auto corner : corners) {
-    for (int i = 0; i < subdiv; i++) {
-      float angle1 = corner.startAngle + (glm::half_pi<float>() * i / subdiv);
-      float angle2 = corner.startAngle + (glm::half_pi<float>() * (i + 1) / subdiv);
-
-      float x1 = corner.center.x + radis.topLeft * glm::cos(angle1);
-      float y1 = corner.center.y + radis.topRight * glm::sin(angle1);
-      float x2 = corner.center.x + radis.bottomLeft * glm::cos(angle2);
-      float y2 = corner.center.y + radis.topLeft * glm::sin(angle2);
-
-      // Add triangle (corner center, point1, point2)
-      vertices.push_back({{corner.center}, col});
-      vertices.push_back({{x1, y1}, col});
-      vertices.push_back({{x2, y2}, col});
+  // Unique vertices: 4 corner centers followed by (subdiv + 1) arc points per corner.
+  // The first and last arc point of a corner double as the outer vertices of the adjacent edge quads.
+  const u32 arcPoints = subdiv + 1;
+  const u32 base = beginPrimitive(scissor, c.a() == 255, 4 + 4 * arcPoints);
+
+  for (const Corner &corner : corners) {
+    vertices.push_back({corner.center, c});
+  }
+
+  for (const Corner &corner : corners) {
+    for (int i = 0; i <= subdiv; i++) {
+      const float angle = corner.startAngle + (glm::half_pi<float>() * i / subdiv);
+      vertices.push_back({{corner.center.x + corner.radius * glm::cos(angle), corner.center.y + corner.radius * glm::sin(angle)}, c});
     }
   }
 
+  const auto center = [base](const u32 corner) { return base + corner; };
+  const auto arc = [base, arcPoints](const u32 corner, const u32 i) { return base + 4 + corner * arcPoints + i; };
+  const u32 last = arcPoints - 1;
+
+  // Corner fans (corner center, point1, point2)
+  for (u32 corner = 0; corner < 4; ++corner) {
+    for (u32 i = 0; i < static_cast<u32>(subdiv); ++i) {
+      indices.insert(indices.end(), {center(corner), arc(corner, i), arc(corner, i + 1)});
+    }
+    commands.back().indexCount += 3 * subdiv;
+  }
+
   // Inner rectangle (central part)
-  vertices.push_back({{innerLeft, innerBottom}, col});
-  vertices.push_back({{innerRight, innerBottom}, col});
-  vertices.push_back({{innerRight, innerTop}, col});
+  quad(center(0), center(1), center(2), center(3));
+
+  // Bottom, right, top and left rectangles
+  quad(arc(0, last), arc(1, 0), center(1), center(0));
+  quad(arc(1, last), arc(2, 0), center(2), center(1));
+  quad(arc(2, last), arc(3, 0), center(3), center(2));
+  quad(arc(3, last), arc(0, 0), center(0), center(3));
+}
+
+// Decodes the UTF-8 sequence starting at i and moves i past it. Malformed sequences decode to U+FFFD.
+static u32 decodeUtf8(const std::string_view utf8, size_t &i) {
+  const u8 lead = static_cast<u8>(utf8[i++]);
+  if (lead < 0x80) return lead;
+
+  u32 continuation, codepoint;
+  if ((lead & 0xE0) == 0xC0) { continuation = 1; codepoint = lead & 0x1F; }
+  else if ((lead & 0xF0) == 0xE0) { continuation = 2; codepoint = lead & 0x0F; }
+  else if ((lead & 0xF8) == 0xF0) { continuation = 3; codepoint = lead & 0x07; }
+  else return 0xFFFD;
+
+  for (u32 n = 0; n < continuation; ++n) {
+    if (i >= utf8.size() || (static_cast<u8>(utf8[i]) & 0xC0) != 0x80) return 0xFFFD;
+    codepoint = codepoint << 6 | (static_cast<u8>(utf8[i++]) & 0x3F);
+  }
+  return codepoint;
+}
+
+void VKUIX::RenderList::image(float x, float y, float w, float h, const TextureId texture, const Color tint, glm::vec4 uv) {
+  const u64 callHash = hashWords({OP_IMAGE, bits(x), bits(y), bits(w), bits(h), texture, tint.packed(),
+                                  bits(uv.x), bits(uv.y), bits(uv.z), bits(uv.w)});
+
+  u16 scissor;
+  if (w <= 0.0f || h <= 0.0f || !clip(x, y, x + w, y + h, scissor)) return;
+  damage(callHash, x, y, x + w, y + h);
+
+  // Trimmed like rect, the uv rect shrinks by the same fractions.
+  if (scissor != 0) {
+    const ClipRect &top = clipStack.back();
+    const float x0 = glm::max(x, top.x0);
+    const float y0 = glm::max(y, top.y0);
+    const float x1 = glm::min(x + w, top.x1);
+    const float y1 = glm::min(y + h, top.y1);
+    uv = {uv.x + uv.z * (x0 - x) / w, uv.y + uv.w * (y0 - y) / h, uv.z * (x1 - x0) / w, uv.w * (y1 - y0) / h};
+    x = x0;
+    y = y0;
+    w = x1 - x0;
+    h = y1 - y0;
+    scissor = 0;
+  }
 
-  vertices.push_back({{innerLeft, innerBottom}, col});
-  vertices.push_back({{innerRight, innerTop}, col});
-  vertices.push_back({{innerLeft, innerTop}, col});
+  // Texels may be translucent whatever the tint.
+  command(PipelineId::Textured, scissor, false).count++;
+  textured.push_back({{x, y, w, h}, uv, tint, TextureTable::slot(texture)});
+}
 
-  // Bottom rectangle
-  vertices.push_back({{innerLeft, bottom}, col});
-  vertices.push_back({{innerRight, bottom}, col});
-  vertices.push_back({{innerRight, innerBottom}, col});
+void VKUIX::RenderList::setGlyphAtlas(GlyphAtlas *atlas, const TextureId texture) {
+  glyphAtlas = atlas;
+  glyphTexture = texture;
+}
 
-  vertices.push_back({{innerLeft, bottom}, col});
-  vertices.push_back({{innerRight, innerBottom}, col});
-  vertices.push_back({{innerLeft, innerBottom}, col});
+float VKUIX::RenderList::text(const FontId font, const float size, const float x, const float y, const std::string_view utf8, const Color c) {
+  // The string goes into the call hash four bytes at a time.
+  u64 callHash = mix(HASH_SEED, {OP_TEXT, font, bits(size), bits(x), bits(y), c.packed(), static_cast<u32>(utf8.size())});
+  for (size_t i = 0; i < utf8.size(); i += 4) {
+    u32 word = 0;
+    memcpy(&word, utf8.data() + i, glm::min<size_t>(4, utf8.size() - i));
+    callHash = mix(callHash, {word});
+  }
 
-  // Right rectangle
-  vertices.push_back({{innerRight, innerBottom}, col});
-  vertices.push_back({{right, innerBottom}, col});
-  vertices.push_back({{right, innerTop}, col});
+  if (!glyphAtlas) {
+    hashWords({static_cast<u32>(callHash), static_cast<u32>(callHash >> 32)});
+    LOG_FIRST(W, 1, "RenderList::text without a glyph atlas, see setGlyphAtlas.");
+    return 0.0f;
+  }
+
+  // The atlas is shared by every thread filling a list, so its lock is only held for single lookups.
+  float lineHeight, baseline;
+  {
+    const std::unique_lock<std::mutex> atlasLock = glyphAtlas->lock();
+    const Font *source = glyphAtlas->getFont(font);
+    if (!source) {
+      hashWords({static_cast<u32>(callHash), static_cast<u32>(callHash >> 32)});
+      LOG_FIRST(W, 1, "RenderList::text with unknown font " << font << ".");
+      return 0.0f;
+    }
+    const float scale = source->scaleForSize(size);
+    lineHeight = glm::round((source->getAscent() - source->getDescent() + source->getLineGap()) * scale);
+    baseline = glm::round(y + source->getAscent() * scale);
+  }
+  float penX = x;
+  float width = 0.0f;
+  float x0 = FLT_MAX, y0 = FLT_MAX, x1 = -FLT_MAX, y1 = -FLT_MAX;
+  constexpr float atlasSize = GlyphAtlas::SIZE;
+  const u32 atlasSlot = TextureTable::slot(glyphTexture);
 
-  vertices.push_back({{innerRight, innerBottom}, col});
-  vertices.push_back({{right, innerTop}, col});
-  vertices.push_back({{innerRight, innerTop}, col});
+  for (size_t i = 0; i < utf8.size();) {
+    const u32 codepoint = decodeUtf8(utf8, i);
+    if (codepoint == '\n') {
+      width = glm::max(width, penX - x);
+      penX = x;
+      baseline += lineHeight;
+      continue;
+    }
 
-  // Top rectangle
-  vertices.push_back({{innerLeft, innerTop}, col});
-  vertices.push_back({{innerRight, innerTop}, col});
-  vertices.push_back({{innerRight, top}, col});
+    // Copied, the pointer is only valid while the lock is held.
+    GlyphAtlas::Glyph glyph;
+    {
+      const std::unique_lock<std::mutex> atlasLock = glyphAtlas->lock();
+      const GlyphAtlas::Glyph *cached = glyphAtlas->glyph(font, codepoint, size);
+      if (!cached) continue;
+      glyph = *cached;
+    }
 
-  vertices.push_back({{innerLeft, innerTop}, col});
-  vertices.push_back({{innerRight, top}, col});
-  vertices.push_back({{innerLeft, top}, col});
+    // Snapped to whole pixels, so the quad samples the atlas texel for texel.
+    if (glyph.width > 0) {
+      const float gx = glm::round(penX) + static_cast<float>(glyph.offsetX);
+      const float gy = baseline + static_cast<float>(glyph.offsetY);
+      const float gw = glyph.width;
+      const float gh = glyph.height;
 
-  // Left rectangle
-  vertices.push_back({{left, innerBottom}, col});
-  vertices.push_back({{innerLeft, innerBottom}, col});
-  vertices.push_back({{innerLeft, innerTop}, col});
+      u16 scissor;
+      if (clip(gx, gy, gx + gw, gy + gh, scissor)) {
+        x0 = glm::min(x0, gx);
+        y0 = glm::min(y0, gy);
+        x1 = glm::max(x1, gx + gw);
+        y1 = glm::max(y1, gy + gh);
+        command(PipelineId::Textured, scissor, false).count++;
+        textured.push_back({{gx, gy, gw, gh}, glm::vec4(glyph.x, glyph.y, glyph.width, glyph.height) / atlasSize, c, atlasSlot});
+      }
+    }
+    penX += glyph.advance;
+  }
+  width = glm::max(width, penX - x);
 
-  vertices.push_back({{left, innerBottom}, col});
-  vertices.push_back({{innerLeft, innerTop}, col});
-  vertices.push_back({{left, innerTop}, col});
+  // Evicting a band moves the glyphs cached in it, so equal text can land on other atlas texels than before.
+  // Read after the lookups, which may have evicted themselves.
+  u32 generation;
+  {
+    const std::unique_lock<std::mutex> atlasLock = glyphAtlas->lock();
+    generation = glyphAtlas->getGeneration();
+  }
+  hashWords({static_cast<u32>(callHash), static_cast<u32>(callHash >> 32), generation});
+  if (x0 < x1) damage(callHash, x0, y0, x1, y1);
+  return width;
 }
 
 std::vector<VkBackend::Vertex> &VKUIX::RenderList::getVertices() {
   return vertices;
 }
 
+std::vector<u32> &VKUIX::RenderList::getIndices() {
+  return indices;
+}
+
+std::vector<VkBackend::RectInstance> &VKUIX::RenderList::getRects() {
+  return rects;
+}
+
+std::vector<VkBackend::TexturedInstance> &VKUIX::RenderList::getTextured() {
+  return textured;
+}
+
+std::vector<VKUIX::DrawCmd> &VKUIX::RenderList::getCommands() {
+  return commands;
+}
+
+std::vector<VkRect2D> &VKUIX::RenderList::getScissors() {
+  return scissors;
+}
+
+u32 VKUIX::RenderList::getCulledCount() const {
+  return culled;
+}
+
+u64 VKUIX::RenderList::getHash() const {
+  return hash;
+}
+
+VkRect2D VKUIX::RenderList::getDamage() const {
+  if (fullDamage) return {{0, 0}, viewport};
+
+  float x0 = FLT_MAX, y0 = FLT_MAX, x1 = -FLT_MAX, y1 = -FLT_MAX;
+  const auto add = [&](const DamageRecord &record) {
+    x0 = glm::min(x0, record.x0);
+    y0 = glm::min(y0, record.y0);
+    x1 = glm::max(x1, record.x1);
+    y1 = glm::max(y1, record.y1);
+  };
+
+  // A changed primitive damages both where it was and where it is now.
+  const size_t common = glm::min(damageRecords.size(), previousDamageRecords.size());
+  for (size_t i = 0; i < common; ++i) {
+    if (damageRecords[i].hash == previousDamageRecords[i].hash) continue;
+    add(damageRecords[i]);
+    add(previousDamageRecords[i]);
+  }
+  for (size_t i = common; i < damageRecords.size(); ++i) add(damageRecords[i]);
+  for (size_t i = common; i < previousDamageRecords.size(); ++i) add(previousDamageRecords[i]);
+
+  x0 = glm::max(glm::floor(x0), 0.0f);
+  y0 = glm::max(glm::floor(y0), 0.0f);
+  if (viewport.width > 0) {
+    x1 = glm::min(x1, static_cast<float>(viewport.width));
+    y1 = glm::min(y1, static_cast<float>(viewport.height));
+  }
+  x1 = glm::ceil(x1);
+  y1 = glm::ceil(y1);
+  if (x1 <= x0 || y1 <= y0) return {};
+
+  return {{static_cast<int32_t>(x0), static_cast<int32_t>(y0)}, {static_cast<u32>(x1 - x0), static_cast<u32>(y1 - y0)}};
+}
+
+void VKUIX::RenderList::pushClipRect(const float x, const float y, const float w, const float h) {
+  hashWords({OP_PUSH_CLIP, bits(x), bits(y), bits(w), bits(h)});
+
+  // Snap outwards to whole pixels so culling agrees with the scissor.
+  ClipRect clipRect{glm::floor(x), glm::floor(y), glm::ceil(x + w), glm::ceil(y + h), 0};
+  if (!clipStack.empty()) {
+    const ClipRect &top = clipStack.back();
+    clipRect.x0 = glm::max(clipRect.x0, top.x0);
+    clipRect.y0 = glm::max(clipRect.y0, top.y0);
+    clipRect.x1 = glm::max(glm::min(clipRect.x1, top.x1), clipRect.x0);
+    clipRect.y1 = glm::max(glm::min(clipRect.y1, top.y1), clipRect.y0);
+  }
+
+  if (scissors.size() > UINT16_MAX) {
+    LOG_FIRST(W, 1, "RenderList ran out of scissor slots, reusing the current clip.");
+    clipStack.push_back(clipStack.empty() ? clipRect : clipStack.back());
+    return;
+  }
+
+  VkRect2D scissor{};
+  scissor.offset = {static_cast<int32_t>(glm::max(clipRect.x0, 0.0f)), static_cast<int32_t>(glm::max(clipRect.y0, 0.0f))};
+  scissor.extent = {static_cast<u32>(glm::max(clipRect.x1 - scissor.offset.x, 0.0f)), static_cast<u32>(glm::max(clipRect.y1 - scissor.offset.y, 0.0f))};
+  clipRect.scissor = scissors.size();
+  scissors.push_back(scissor);
+  clipStack.push_back(clipRect);
+}
+
+void VKUIX::RenderList::popClipRect() {
+  hashWords({OP_POP_CLIP});
+
+  // The viewport clip at the bottom of the stack stays.
+  if (clipStack.size() > (viewport.width > 0 ? 1 : 0)) {
+    clipStack.pop_back();
+  } else {
+    LOG(W, "popClipRect without matching pushClipRect.");
+  }
+}
+
+void VKUIX::RenderList::setViewport(const VkExtent2D extent) {
+  hashWords({OP_VIEWPORT, extent.width, extent.height});
+
+  viewport = extent;
+  fullDamage = true;
+  clipStack.clear();
+  clipStack.push_back({0.0f, 0.0f, static_cast<float>(extent.width), static_cast<float>(extent.height), 0});
+}
+
+void VKUIX::RenderList::setLayer(const u16 layer) {
+  hashWords({OP_LAYER, layer});
+
+  this->layer = layer;
+}
+
+u16 VKUIX::RenderList::getLayer() const {
+  return layer;
+}
+
 void VKUIX::RenderList::clear() {
+  // Keep the capacity around, the next frame usually emits about the same amount of geometry.
   vertices.clear();
-  vertices = std::vector<VkBackend::Vertex>();
+  indices.clear();
+  rects.clear();
+  textured.clear();
+  commands.clear();
+  scissors.resize(1);
+  clipStack.resize(viewport.width > 0 ? 1 : 0);
+  culled = 0;
+  hash = HASH_SEED;
+  previousDamageRecords.swap(damageRecords);
+  damageRecords.clear();
+  fullDamage = false;
+
+  layer = 0;
 }
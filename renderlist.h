@@ -1,11 +1,52 @@
 #pragma once
 
+#include <string_view>
+
+#include "glyph_atlas.h"
+#include "textures.h"
 #include "vulkan_backend.h"
 
 namespace VKUIX {
 
+  // Pipeline a draw command is recorded with. Part of the sort key, so the order
+  // here is the draw order of commands that share a layer.
+  enum class PipelineId : u8 {
+    Triangles = 0, // Indexed VkBackend::Vertex geometry
+    RoundRect = 1, // Instanced VkBackend::RectInstance quads
+    Textured = 2, // Instanced VkBackend::TexturedInstance quads sampling the texture table
+  };
+  inline constexpr u32 PIPELINE_ID_COUNT = 3;
+
+  // A range of geometry that shares all GPU state. Commands are recorded in call order and
+  // sorted by key at submit time, adjacent commands with equal keys and opacity are merged into one draw.
+  // Within a layer, commands may be reordered by state. Use layers to force a painter's order.
+  struct DrawCmd {
+    u64 key{0};
+
+    PipelineId pipeline{PipelineId::Triangles};
+    u16 layer{0};
+    u16 scissor{0}; // Index into RenderList::getScissors(), 0 = full render area
+    // Every primitive covers its pixels with alpha 255, apart from antialiased edges. Drawn front to back in the opaque pass
+    // so early depth testing rejects what they hide, see DrawBatcher. Not part of the key, so the paint order is unchanged.
+    bool opaque{false};
+
+    u32 first{0}; // First vertex for Triangles, first instance for RoundRect and Textured
+    u32 count{0}; // Vertex or instance count
+    u32 firstIndex{0}; // Triangles only, indices are relative to first
+    u32 indexCount{0};
+
+    // Most significant first: layer | pipeline | scissor.
+    static constexpr u64 makeKey(const u16 layer, const PipelineId pipeline, const u16 scissor) {
+      return static_cast<u64>(layer) << 32 | static_cast<u64>(pipeline) << 24 | static_cast<u64>(scissor) << 8;
+    }
+  };
+
   class RenderList {
   public:
+    // A draw never references more vertices than this, so 16 bit indices are enough
+    // unless a single primitive needs more.
+    static constexpr u32 MAX_BATCH_VERTICES = 1u << 16;
+
     void rect(float x, float y, float w, float h, Color c);
 
     struct BorderRadius {
@@ -18,14 +59,100 @@ namespace VKUIX {
       float bottomLeft;
       float bottomRight;
     };
-    void roundRect(float x, float y, float w, float h, BorderRadius radis, int subdiv, Color c);
+    // Rounded rectangle drawn as one SDF instance. Corners are resolution independent and antialiased.
+    void roundRect(float x, float y, float w, float h, BorderRadius radis, Color c, float borderWidth = 0.0f, Color borderColor = {});
+    // Rounded rectangle tessellated into triangles on the CPU, subdiv segments per corner.
+    void roundRectMesh(float x, float y, float w, float h, BorderRadius radis, int subdiv, Color c);
+
+    // Draws the part uv (x, y, width, height, normalized) of texture stretched over the rect, multiplied by tint.
+    // Textured primitives merge into one draw whatever their texture, see TextureTable. The texture has to stay
+    // in the table until the frames drawing it have been rendered.
+    void image(float x, float y, float w, float h, TextureId texture, Color tint = {255, 255, 255}, glm::vec4 uv = {0.0f, 0.0f, 1.0f, 1.0f});
+
+    // Atlas text() rasterizes into and looks glyphs up in, drawn from its texture table slot.
+    // Shared by every RenderList of an instance.
+    void setGlyphAtlas(GlyphAtlas *atlas, TextureId texture);
+    // Draws UTF-8 text as one quad per glyph, with the top of the first line at y. Lines are split at '\n'.
+    // Glyphs are snapped to whole pixels. Glyphs seen before only cost a cache lookup, new ones are rasterized
+    // into the atlas first. Returns the width of the widest line.
+    float text(FontId font, float size, float x, float y, std::string_view utf8, Color c);
+
+    // Clips everything recorded afterwards to the given rect, intersected with the current clip.
+    // Primitives entirely outside the clip are dropped before tessellation, axis aligned rects are trimmed
+    // and only primitives crossing the clip edge are drawn with a scissor.
+    void pushClipRect(float x, float y, float w, float h);
+    void popClipRect();
+
+    // Area the RenderList is drawn into, acts as the outermost clip rect.
+    void setViewport(VkExtent2D extent);
+
+    // Layer of everything recorded afterwards. Higher layers are drawn on top.
+    void setLayer(u16 layer);
+    [[nodiscard]] u16 getLayer() const;
 
     std::vector<VkBackend::Vertex>& getVertices();
+    std::vector<u32>& getIndices();
+    std::vector<VkBackend::RectInstance>& getRects();
+    std::vector<VkBackend::TexturedInstance>& getTextured();
+    std::vector<DrawCmd>& getCommands();
+    std::vector<VkRect2D>& getScissors();
+    // Primitives rejected by clipping since the last clear().
+    [[nodiscard]] u32 getCulledCount() const;
+    // Rolling hash of every call since the last clear(). Equal hashes mean equal GPU content.
+    [[nodiscard]] u64 getHash() const;
+    // Pixels that differ from the content recorded before the last clear(), snapped outwards to whole pixels.
+    // Primitives are compared in call order, so inserting one damages everything recorded after it.
+    // An empty extent means nothing changed, the full viewport after setViewport().
+    [[nodiscard]] VkRect2D getDamage() const;
 
     void clear();
   private:
     std::vector<VkBackend::Vertex> vertices;
     std::vector<u32> indices;
+    std::vector<VkBackend::RectInstance> rects;
+    std::vector<VkBackend::TexturedInstance> textured;
+    std::vector<DrawCmd> commands;
+    std::vector<VkRect2D> scissors{VkRect2D{}};
+
+    struct ClipRect {
+      float x0, y0, x1, y1;
+      u16 scissor; // Scissor used by primitives crossing this clip
+    };
+    std::vector<ClipRect> clipStack{};
+    VkExtent2D viewport{};
+    u32 culled{0};
+
+    static constexpr u64 HASH_SEED = 0xcbf29ce484222325ull;
+    u64 hash{HASH_SEED};
+    static u64 mix(u64 seed, std::initializer_list<u32> words);
+    // Folds a call into the rolling hash and returns the hash of the call alone.
+    u64 hashWords(std::initializer_list<u32> words);
+    static u32 bits(float value);
+
+    // Visible bounds of every primitive that survived clipping, compared against the previous frame for damage.
+    struct DamageRecord {
+      u64 hash; // Call hash combined with the visible bounds and the layer
+      float x0, y0, x1, y1;
+    };
+    std::vector<DamageRecord> damageRecords{};
+    std::vector<DamageRecord> previousDamageRecords{};
+    bool fullDamage{false};
+    void damage(u64 callHash, float x0, float y0, float x1, float y1);
+
+    u16 layer{0};
+    GlyphAtlas *glyphAtlas{nullptr};
+    TextureId glyphTexture{INVALID_TEXTURE};
+
+    // Classifies a primitive's bounds against the current clip. Returns false if it is entirely outside,
+    // otherwise the scissor to draw it with: 0 when it is fully inside, the clip's scissor when it crosses the edge.
+    bool clip(float x0, float y0, float x1, float y1, u16 &scissorOut);
+
+    // Returns the command the next primitive is appended to, a new one if the state changed
+    // or the vertex budget of the current one is exhausted.
+    DrawCmd &command(PipelineId pipeline, u16 scissor, bool opaque, u32 vertexCount = 0);
+    // Makes room for a primitive with vertexCount vertices and returns the command relative index of its first vertex.
+    u32 beginPrimitive(u16 scissor, bool opaque, u32 vertexCount);
+    void quad(u32 a, u32 b, u32 c, u32 d);
   };
 
-}
\ No newline at end of file
+}
@@ -1,46 +1,91 @@
 #include "shader.h"
 
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 
+#include "embedded_shaders.h"
+
 Shader::Shader(VkDevice device, const std::string &filename) {
-  fragModule = loadModule(device, filename, TYPE_FRAG_SHADER);
   vertModule = loadModule(device, filename, TYPE_VERT_SHADER);
+  fragModule = loadModule(device, filename, TYPE_FRAG_SHADER);
 }
+
+Shader::Shader(VkDevice device, const std::span<const u32> vertCode, const std::span<const u32> fragCode) {
+  vertModule = createModule(device, vertCode);
+  fragModule = createModule(device, fragCode);
+}
+
 std::array<VkPipelineShaderStageCreateInfo, 2> Shader::getShaderStageInfos() {
   std::array<VkPipelineShaderStageCreateInfo, 2> infos{};
 
   infos[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-  infos[0].stage = TYPE_FRAG_SHADER.shaderFlag;
-  infos[0].module = fragModule;
+  infos[0].stage = TYPE_VERT_SHADER.shaderFlag;
+  infos[0].module = vertModule;
   infos[0].pName = "main";
 
   infos[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-  infos[1].stage = TYPE_VERT_SHADER.shaderFlag;
-  infos[1].module = vertModule;
+  infos[1].stage = TYPE_FRAG_SHADER.shaderFlag;
+  infos[1].module = fragModule;
   infos[1].pName = "main";
 
   return infos;
 }
 
-VkShaderModule Shader::loadModule(const VkDevice device, const std::string &filename, const ShaderType type) {
-  std::ifstream file{"../assets/shader/" + filename + "." + type.fileTypeName + ".spv", std::ios::ate | std::ios::binary};
-  if (!file.is_open()) LOG(W, "Could not open shader file: " << filename);
+void Shader::destroy(const VkDevice device) {
+  vkDestroyShaderModule(device, fragModule, nullptr);
+  vkDestroyShaderModule(device, vertModule, nullptr);
+  fragModule = VK_NULL_HANDLE;
+  vertModule = VK_NULL_HANDLE;
+}
 
-  const size_t fileSize = file.tellg();
-  std::vector<char> buffer(fileSize);
-  file.seekg(0);
-  file.read(buffer.data(), fileSize);
-  file.close();
+std::span<const u32> Shader::findEmbedded(const std::string &filename, const ShaderType &type) {
+  for (const EmbeddedShaders::Entry &entry : EmbeddedShaders::ENTRIES) {
+    if (filename == entry.shader && strcmp(entry.stage, type.fileTypeName) == 0) return entry.code;
+  }
+  return {};
+}
 
+VkShaderModule Shader::createModule(const VkDevice device, const std::span<const u32> code) {
   VkShaderModule module{};
+  if (code.empty()) return module;
 
   VkShaderModuleCreateInfo info{VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO};
-  info.codeSize = buffer.size();
-  info.pCode = reinterpret_cast<const uint32_t*>(buffer.data());
+  info.codeSize = code.size_bytes();
+  info.pCode = code.data();
 
   if (vkCreateShaderModule(device, &info, nullptr, &module) != VK_SUCCESS) {
     LOG(W, "Could not create VkShaderModule.");
   }
 
   return module;
-}
\ No newline at end of file
+}
+
+VkShaderModule Shader::loadModule(const VkDevice device, const std::string &filename, const ShaderType &type) {
+  const char *shaderDir = std::getenv(SHADER_DIR_ENV);
+  if (!shaderDir || !*shaderDir) {
+    const std::span<const u32> code = findEmbedded(filename, type);
+    if (code.empty()) LOG(W, "No embedded SPIR-V for shader " << filename << "." << type.fileTypeName);
+    return createModule(device, code);
+  }
+
+  // Read into words, pCode has to be 4 byte aligned.
+  const std::string path = std::string(shaderDir) + "/" + filename + "." + type.fileTypeName + ".spv";
+  std::ifstream file{path, std::ios::ate | std::ios::binary};
+  if (!file.is_open()) {
+    LOG(W, "Could not open shader file: " << path);
+    return VK_NULL_HANDLE;
+  }
+
+  const size_t fileSize = file.tellg();
+  if (fileSize == 0 || fileSize % sizeof(u32) != 0) {
+    LOG(W, "Shader file is not SPIR-V: " << path);
+    return VK_NULL_HANDLE;
+  }
+  std::vector<u32> code(fileSize / sizeof(u32));
+  file.seekg(0);
+  file.read(reinterpret_cast<char*>(code.data()), static_cast<std::streamsize>(fileSize));
+  LOG(D, "Loaded shader " << path << " from disk.");
+
+  return createModule(device, code);
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <span>
+
 #include "vulkan/vulkan.h"
 #include "common.h"
 
@@ -8,16 +10,27 @@ struct ShaderType {
   const VkShaderStageFlagBits shaderFlag;
 };
 
-inline constexpr ShaderType TYPE_VERT_SHADER{"frag", VK_SHADER_STAGE_FRAGMENT_BIT};
-inline constexpr ShaderType TYPE_FRAG_SHADER{"vert", VK_SHADER_STAGE_VERTEX_BIT};
+inline constexpr ShaderType TYPE_VERT_SHADER{"vert", VK_SHADER_STAGE_VERTEX_BIT};
+inline constexpr ShaderType TYPE_FRAG_SHADER{"frag", VK_SHADER_STAGE_FRAGMENT_BIT};
+
+// Environment variable that, when set, makes Shader load <dir>/<name>.<stage>.spv instead of the embedded code.
+inline constexpr const char *SHADER_DIR_ENV = "VKUIX_SHADER_DIR";
 
 class Shader {
 public:
+  // Uses the SPIR-V embedded at build time from assets/shader, or the files in SHADER_DIR_ENV if that is set.
   explicit Shader(VkDevice device, const std::string& filename);
+  Shader(VkDevice device, std::span<const u32> vertCode, std::span<const u32> fragCode);
   [[nodiscard]] std::array<VkPipelineShaderStageCreateInfo, 2> getShaderStageInfos();
+  // The modules are only needed until the pipelines using them are created.
+  void destroy(VkDevice device);
+
+  // Embedded SPIR-V of a shader stage, empty if there is none.
+  static std::span<const u32> findEmbedded(const std::string &filename, const ShaderType &type);
 private:
   VkShaderModule fragModule;
   VkShaderModule vertModule;
 
-  VkShaderModule loadModule(VkDevice device, const std::string &filename, const ShaderType type);
-};
\ No newline at end of file
+  static VkShaderModule createModule(VkDevice device, std::span<const u32> code);
+  static VkShaderModule loadModule(VkDevice device, const std::string &filename, const ShaderType &type);
+};
@@ -0,0 +1,74 @@
+#include "taskpool.h"
+
+#include <string>
+
+#include "profiler.h"
+
+VKUIX::TaskPool::TaskPool(const u32 workerThreads) {
+  threads.reserve(workerThreads);
+  for (u32 i = 0; i < workerThreads; ++i)
+    threads.emplace_back(&TaskPool::workerLoop, this, i + 1);
+}
+
+VKUIX::TaskPool::~TaskPool() {
+  {
+    std::lock_guard lock{mutex};
+    stopping = true;
+  }
+  wake.notify_all();
+  for (std::thread &thread : threads) thread.join();
+}
+
+u32 VKUIX::TaskPool::getWorkerCount() const {
+  return threads.size() + 1;
+}
+
+void VKUIX::TaskPool::runItems(const u32 worker) const {
+  for (u32 item = worker; item < jobCount; item += getWorkerCount())
+    (*job)(item, worker);
+}
+
+void VKUIX::TaskPool::parallelFor(const u32 count, const std::function<void(u32 item, u32 worker)> &fn) {
+  // Not worth waking anyone, every item still runs as its own worker.
+  if (count <= 1 || threads.empty()) {
+    for (u32 item = 0; item < count; ++item) fn(item, item % getWorkerCount());
+    return;
+  }
+
+  {
+    std::lock_guard lock{mutex};
+    job = &fn;
+    jobCount = count;
+    pending = threads.size();
+    generation++;
+  }
+  wake.notify_all();
+
+  runItems(0);
+
+  std::unique_lock lock{mutex};
+  done.wait(lock, [&] { return pending == 0; });
+  job = nullptr;
+}
+
+void VKUIX::TaskPool::workerLoop(const u32 worker) {
+#ifdef VKUIX_PROFILING
+  const std::string name = "worker " + std::to_string(worker);
+  VKUIX_PROFILE_THREAD(name.c_str());
+#endif
+
+  u64 seen = 0;
+  while (true) {
+    {
+      std::unique_lock lock{mutex};
+      wake.wait(lock, [&] { return stopping || generation != seen; });
+      if (stopping) return;
+      seen = generation;
+    }
+
+    runItems(worker);
+
+    std::lock_guard lock{mutex};
+    if (--pending == 0) done.notify_one();
+  }
+}
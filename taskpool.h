@@ -0,0 +1,47 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "common.h"
+
+namespace VKUIX {
+
+  // Fixed set of worker threads for parallel loops. The calling thread takes part as worker 0.
+  class TaskPool {
+  public:
+    // workerThreads additional threads are started, 0 runs everything on the calling thread.
+    explicit TaskPool(u32 workerThreads);
+    ~TaskPool();
+
+    TaskPool(const TaskPool &) = delete;
+    TaskPool &operator=(const TaskPool &) = delete;
+
+    // Including the calling thread.
+    [[nodiscard]] u32 getWorkerCount() const;
+
+    // Calls fn(item, worker) for every item in [0, count) and returns once all calls returned.
+    // Item i always runs as worker i % getWorkerCount(), so per worker resources need no locking.
+    // Not reentrant, only one thread may call this at a time.
+    void parallelFor(u32 count, const std::function<void(u32 item, u32 worker)> &fn);
+
+  private:
+    void workerLoop(u32 worker);
+    void runItems(u32 worker) const;
+
+    std::vector<std::thread> threads{};
+    std::mutex mutex{};
+    std::condition_variable wake{};
+    std::condition_variable done{};
+
+    const std::function<void(u32, u32)> *job{nullptr};
+    u32 jobCount{0};
+    u64 generation{0}; // Bumped for every parallelFor, workers run once per generation
+    u32 pending{0}; // Worker threads still busy with the current generation
+    bool stopping{false};
+  };
+
+}
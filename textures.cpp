@@ -0,0 +1,116 @@
+#include "textures.h"
+
+#include <algorithm>
+
+void VKUIX::TextureTable::create(const VkBackend::Instance &backend, VkDescriptorPool pool, const VkSampler sampler) {
+  this->sampler = sampler;
+
+  // Unused slots stay unwritten, new ones are written while earlier submissions bound the set are still pending.
+  const VkDescriptorBindingFlags bindingFlags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+                                                VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+  VkDescriptorSetLayoutBindingFlagsCreateInfo flagsInfo{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO};
+  flagsInfo.bindingCount = 1;
+  flagsInfo.pBindingFlags = &bindingFlags;
+
+  VkBackend::DescriptorSetLayoutInfo layoutInfo{};
+  layoutInfo.layoutBindings.push_back({0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, CAPACITY, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr});
+  layoutInfo.createFlags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+  layoutInfo.pExt = &flagsInfo;
+  VkBackend::createDescriptorLayout(backend, layoutInfo, layout);
+
+  VkBackend::DescriptorSetAllocInfo allocInfo{};
+  allocInfo.pPool = &pool;
+  allocInfo.layouts = {layout};
+  VkBackend::allocDescriptorSets(backend, allocInfo, set);
+}
+
+void VKUIX::TextureTable::destroyImage(const VkBackend::Instance &backend, Image &image) {
+  vkDestroyImageView(backend.device, image.view, nullptr);
+  vmaDestroyImage(backend.allocator, image.vkImage, image.alloc);
+  image = {};
+}
+
+void VKUIX::TextureTable::destroy(const VkBackend::Instance &backend) {
+  for (Slot &slot : slots)
+    if (slot.image.vkImage) destroyImage(backend, slot.image);
+  slots.clear();
+  freeSlots.clear();
+  retired.clear();
+  count = 0;
+  vkDestroyDescriptorSetLayout(backend.device, layout, nullptr);
+  layout = {};
+  set = {}; // Freed with its pool
+}
+
+VKUIX::TextureId VKUIX::TextureTable::add(const VkBackend::Instance &backend, const Image &image) {
+  u32 index;
+  if (!freeSlots.empty()) {
+    index = freeSlots.back();
+    freeSlots.pop_back();
+  } else if (slots.size() < CAPACITY) {
+    index = slots.size();
+    slots.emplace_back();
+  } else {
+    LOG_FIRST(W, 1, "Texture table is full with " << CAPACITY << " textures.");
+    return INVALID_TEXTURE;
+  }
+
+  Slot &entry = slots[index];
+  entry.image = image;
+  entry.used = true;
+  // Generation 0 is never handed out, so no id equals INVALID_TEXTURE.
+  if (++entry.generation == 0) entry.generation = 1;
+  count++;
+
+  VkDescriptorImageInfo imageInfo{sampler, image.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+  VkWriteDescriptorSet write{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+  write.dstSet = set;
+  write.dstBinding = 0;
+  write.dstArrayElement = index;
+  write.descriptorCount = 1;
+  write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  write.pImageInfo = &imageInfo;
+  vkUpdateDescriptorSets(backend.device, 1, &write, 0, nullptr);
+
+  return static_cast<TextureId>(entry.generation) << 16 | index;
+}
+
+bool VKUIX::TextureTable::contains(const TextureId texture) const {
+  const u32 index = slot(texture);
+  return index < slots.size() && slots[index].used && slots[index].generation == texture >> 16;
+}
+
+void VKUIX::TextureTable::retire(const TextureId texture, const u64 frame) {
+  if (!contains(texture)) {
+    LOG(W, "Texture " << texture << " is not in the texture table.");
+    return;
+  }
+  slots[slot(texture)].used = false;
+  retired.push_back({slot(texture), frame});
+  count--;
+}
+
+void VKUIX::TextureTable::collect(const VkBackend::Instance &backend, const u64 completedFrames) {
+  // Retired in submission order, so the completed ones are a prefix.
+  const auto pending = std::find_if(retired.begin(), retired.end(), [completedFrames](const Retired &entry) {
+    return entry.frame > completedFrames;
+  });
+  for (auto it = retired.begin(); it != pending; ++it) {
+    // The descriptor keeps pointing at the destroyed view, partially bound allows that while nothing samples it.
+    destroyImage(backend, slots[it->slot].image);
+    freeSlots.push_back(it->slot);
+  }
+  retired.erase(retired.begin(), pending);
+}
+
+VkDescriptorSetLayout VKUIX::TextureTable::getLayout() const {
+  return layout;
+}
+
+VkDescriptorSet VKUIX::TextureTable::getSet() const {
+  return set;
+}
+
+u32 VKUIX::TextureTable::getCount() const {
+  return count;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+
+#include "vulkan_backend.h"
+
+namespace VKUIX {
+
+  // Texture in the TextureTable. The slot sits in the low 16 bits, the slot's generation in the high 16,
+  // so a recycled slot never gives the same id twice and RenderList hashes see the change.
+  using TextureId = u32;
+  inline constexpr TextureId INVALID_TEXTURE = 0;
+
+  // One descriptor array of every sampled texture, set 1 of the pipeline layout. Instances name their texture
+  // by slot, so textured primitives from any source merge into one draw and the set is bound once per layer buffer.
+  // The binding is partially bound and update after bind: slots are written while recorded layer buffers
+  // that bind the set are cached or still executing, which is fine as long as they do not sample those slots.
+  class TextureTable {
+  public:
+    static constexpr u32 CAPACITY = 4096;
+
+    static constexpr u32 slot(const TextureId texture) { return texture & 0xFFFF; }
+
+    // The layout and set live until destroy, sampler is used for every slot.
+    void create(const VkBackend::Instance &backend, VkDescriptorPool pool, VkSampler sampler);
+    // Destroys every image in the table, retired or not. The device has to be idle.
+    void destroy(const VkBackend::Instance &backend);
+
+    // Takes ownership of image, which has to be in SHADER_READ_ONLY_OPTIMAL layout whenever it is sampled.
+    // Returns INVALID_TEXTURE if every slot is taken.
+    TextureId add(const VkBackend::Instance &backend, const Image &image);
+    // Whether texture is in the table and not retired.
+    [[nodiscard]] bool contains(TextureId texture) const;
+    // Removes texture from the table. Submissions before submission number frame may still sample it,
+    // its image is destroyed and its slot reused by the first collect that sees them all completed.
+    void retire(TextureId texture, u64 frame);
+    // Frees what was retired before completedFrames, the number of submissions known to have completed.
+    void collect(const VkBackend::Instance &backend, u64 completedFrames);
+
+    [[nodiscard]] VkDescriptorSetLayout getLayout() const;
+    [[nodiscard]] VkDescriptorSet getSet() const;
+    [[nodiscard]] u32 getCount() const; // Textures in the table, retired ones excluded
+
+  private:
+    struct Slot {
+      Image image{};
+      u16 generation{0};
+      bool used{false};
+    };
+    struct Retired {
+      u32 slot;
+      u64 frame;
+    };
+
+    VkDescriptorSetLayout layout{};
+    VkDescriptorSet set{};
+    VkSampler sampler{};
+    std::vector<Slot> slots{};
+    std::vector<u32> freeSlots{};
+    std::vector<Retired> retired{};
+    u32 count{0};
+
+    static void destroyImage(const VkBackend::Instance &backend, Image &image);
+  };
+
+}
@@ -0,0 +1,241 @@
+#include "upload_manager.h"
+
+#include "profiler.h"
+
+// Staging writes are 16 byte aligned, enough for copies of any texel format the renderer uploads.
+static constexpr VkDeviceSize STAGING_ALIGNMENT = 16;
+
+static u8 *createStaging(const VmaAllocator allocator, const VkDeviceSize size, Buffers::Buffer &bufferOut) {
+  VkBufferCreateInfo bufferInfo{VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+  bufferInfo.size = size;
+  bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+  bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  VmaAllocationCreateInfo allocInfo{};
+  allocInfo.usage = VMA_MEMORY_USAGE_CPU_ONLY;
+  allocInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+  VmaAllocationInfo allocResult{};
+  if (vmaCreateBuffer(allocator, &bufferInfo, &allocInfo, &bufferOut.buffer, &bufferOut.allocation, &allocResult) != VK_SUCCESS) {
+    LOG(F, "Could not allocate " << size << " bytes of staging memory.");
+  }
+  return static_cast<u8*>(allocResult.pMappedData);
+}
+
+void VKUIX::UploadManager::create(const VkBackend::Instance &backend, const VkCommandPool pool, const VkDeviceSize stagingSize) {
+  this->pool = pool;
+
+  VkSemaphoreTypeCreateInfo typeInfo{VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO};
+  typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+  typeInfo.initialValue = 0;
+  VkSemaphoreCreateInfo semaInfo{VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+  semaInfo.pNext = &typeInfo;
+  if (vkCreateSemaphore(backend.device, &semaInfo, nullptr, &timeline) != VK_SUCCESS) {
+    LOG(F, "Could not create the upload timeline semaphore.");
+  }
+
+  capacity = Buffers::alignUp(stagingSize, STAGING_ALIGNMENT);
+  mapped = createStaging(backend.allocator, capacity, staging);
+}
+
+void VKUIX::UploadManager::destroy(const VkBackend::Instance &backend) {
+  for (Batch &batch : inFlight)
+    for (Buffers::Buffer &buffer : batch.oversized) Buffers::freeBuffer(buffer, backend.allocator);
+  for (Buffers::Buffer &buffer : recording.oversized) Buffers::freeBuffer(buffer, backend.allocator);
+  inFlight.clear();
+  recording = {};
+  recordingOpen = false;
+  freeCmdBuffers.clear(); // Freed with the pool
+
+  Buffers::freeBuffer(staging, backend.allocator);
+  mapped = nullptr;
+  vkDestroySemaphore(backend.device, timeline, nullptr);
+  timeline = {};
+}
+
+void VKUIX::UploadManager::reclaim(const VkBackend::Instance &backend) {
+  if (inFlight.empty()) return;
+  u64 completed = 0;
+  vkGetSemaphoreCounterValue(backend.device, timeline, &completed);
+
+  while (!inFlight.empty() && inFlight.front().value <= completed) {
+    Batch &batch = inFlight.front();
+    tail = (tail + batch.bytes) % capacity;
+    used -= batch.bytes;
+    for (Buffers::Buffer &buffer : batch.oversized) Buffers::freeBuffer(buffer, backend.allocator);
+    freeCmdBuffers.push_back(batch.cmdBuffer);
+    inFlight.pop_front();
+  }
+}
+
+bool VKUIX::UploadManager::tryAllocate(const VkDeviceSize size, VkDeviceSize &offsetOut) {
+  if (used == 0) head = tail = 0;
+  if (used + size > capacity) return false;
+
+  if (head > tail || used == 0) {
+    if (head + size <= capacity) {
+      offsetOut = head;
+    } else {
+      // Skip the end of the ring, the skipped bytes are freed together with this batch.
+      const VkDeviceSize skipped = capacity - head;
+      if (size > tail || used + skipped + size > capacity) return false;
+      used += skipped;
+      recording.bytes += skipped;
+      offsetOut = 0;
+    }
+  } else {
+    if (head + size > tail) return false;
+    offsetOut = head;
+  }
+
+  head = offsetOut + size;
+  used += size;
+  recording.bytes += size;
+  return true;
+}
+
+VkBuffer VKUIX::UploadManager::stage(const VkBackend::Instance &backend, const void *data, const VkDeviceSize size, VkDeviceSize &offsetOut) {
+  const VkDeviceSize alignedSize = Buffers::alignUp(size, STAGING_ALIGNMENT);
+  if (alignedSize > capacity) {
+    Buffers::Buffer &buffer = recording.oversized.emplace_back();
+    u8 *dst = createStaging(backend.allocator, size, buffer);
+    memcpy(dst, data, size);
+    vmaFlushAllocation(backend.allocator, buffer.allocation, 0, VK_WHOLE_SIZE);
+    offsetOut = 0;
+    return buffer.buffer;
+  }
+
+  reclaim(backend);
+  while (!tryAllocate(alignedSize, offsetOut)) {
+    VKUIX_PROFILE_ZONE("UploadManager::stall");
+    stats.stalls++;
+    // The batch being recorded holds staging as well, it only drains once submitted.
+    flush(backend);
+    wait(backend, inFlight.front().value);
+  }
+
+  memcpy(mapped + offsetOut, data, size);
+  vmaFlushAllocation(backend.allocator, staging.allocation, offsetOut, size);
+  return staging.buffer;
+}
+
+VkCommandBuffer VKUIX::UploadManager::recordingBuffer(const VkBackend::Instance &backend) {
+  if (!recordingOpen) {
+    VkCommandBuffer cmdBuffer{};
+    if (freeCmdBuffers.empty()) {
+      VkBackend::createCommandbuffer(backend, pool, cmdBuffer);
+    } else {
+      cmdBuffer = freeCmdBuffers.back();
+      freeCmdBuffers.pop_back();
+      vkResetCommandBuffer(cmdBuffer, 0);
+    }
+
+    VkCommandBufferBeginInfo cmdBegin{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+    cmdBegin.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(cmdBuffer, &cmdBegin);
+    recording.cmdBuffer = cmdBuffer;
+    recordingOpen = true;
+  }
+  return recording.cmdBuffer;
+}
+
+VKUIX::UploadTicket VKUIX::UploadManager::uploadBuffer(const VkBackend::Instance &backend, const void *data, const VkDeviceSize size,
+                                                       const VkBuffer dst, const VkDeviceSize dstOffset) {
+  if (size == 0) return submittedValue;
+
+  VkBufferCopy region{};
+  const VkBuffer src = stage(backend, data, size, region.srcOffset);
+  region.dstOffset = dstOffset;
+  region.size = size;
+  vkCmdCopyBuffer(recordingBuffer(backend), src, dst, 1, &region);
+
+  stats.bytes += size;
+  stats.copies++;
+  return submittedValue + 1;
+}
+
+VKUIX::UploadTicket VKUIX::UploadManager::uploadImage(const VkBackend::Instance &backend, const void *texels, const VkDeviceSize size, const Image &dst) {
+  VkBufferImageCopy region{};
+  const VkBuffer src = stage(backend, texels, size, region.bufferOffset);
+  region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  region.imageSubresource.layerCount = 1;
+  region.imageExtent = {dst.extent.width, dst.extent.height, 1};
+
+  VkCommandBuffer cmdBuffer = recordingBuffer(backend);
+  VkImage image = dst.vkImage;
+  VkBackend::transitionImage(cmdBuffer, image,
+                             VK_PIPELINE_STAGE_2_NONE, 0,
+                             VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                             VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+  vkCmdCopyBufferToImage(cmdBuffer, src, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+  // A transfer queue has no shader stages to wait for, the frames sampling the image wait for the semaphore instead.
+  VkBackend::transitionImage(cmdBuffer, image,
+                             VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                             VK_PIPELINE_STAGE_2_NONE, 0,
+                             VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+  stats.bytes += size;
+  stats.copies++;
+  return submittedValue + 1;
+}
+
+void VKUIX::UploadManager::flush(const VkBackend::Instance &backend) {
+  if (!recordingOpen) return;
+  VKUIX_PROFILE_ZONE("UploadManager::flush");
+  vkEndCommandBuffer(recording.cmdBuffer);
+
+  const u64 value = submittedValue + 1;
+  VkTimelineSemaphoreSubmitInfo timelineInfo{VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO};
+  timelineInfo.signalSemaphoreValueCount = 1;
+  timelineInfo.pSignalSemaphoreValues = &value;
+
+  VkSubmitInfo submitInfo{VK_STRUCTURE_TYPE_SUBMIT_INFO};
+  submitInfo.pNext = &timelineInfo;
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &recording.cmdBuffer;
+  submitInfo.signalSemaphoreCount = 1;
+  submitInfo.pSignalSemaphores = &timeline;
+
+  // Tickets of this batch would never land.
+  if (vkQueueSubmit(backend.transferQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+    LOG(F, "Could not submit uploads.");
+
+  submittedValue = value;
+  stats.submissions++;
+  recording.value = value;
+  inFlight.push_back(std::move(recording));
+  recording = {};
+  recordingOpen = false;
+}
+
+bool VKUIX::UploadManager::isComplete(const VkBackend::Instance &backend, const UploadTicket ticket) const {
+  if (ticket > submittedValue) return false;
+  u64 completed = 0;
+  vkGetSemaphoreCounterValue(backend.device, timeline, &completed);
+  return ticket <= completed;
+}
+
+void VKUIX::UploadManager::wait(const VkBackend::Instance &backend, UploadTicket ticket) {
+  if (ticket > submittedValue) flush(backend);
+  ticket = glm::min(ticket, submittedValue);
+  if (ticket == 0) return;
+
+  VkSemaphoreWaitInfo waitInfo{VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO};
+  waitInfo.semaphoreCount = 1;
+  waitInfo.pSemaphores = &timeline;
+  waitInfo.pValues = &ticket;
+  vkWaitSemaphores(backend.device, &waitInfo, UINT64_MAX);
+  reclaim(backend);
+}
+
+VkSemaphore VKUIX::UploadManager::getSemaphore() const {
+  return timeline;
+}
+
+u64 VKUIX::UploadManager::getSubmittedValue() const {
+  return submittedValue;
+}
+
+const VKUIX::UploadManager::Stats &VKUIX::UploadManager::getStats() const {
+  return stats;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+
+#include "buffer.h"
+#include "vulkan_backend.h"
+
+namespace VKUIX {
+
+  // Identifies a queued upload. It has landed once the timeline semaphore of its UploadManager reaches it.
+  using UploadTicket = u64;
+
+  // Copies static content, like textures and retained meshes, into device local buffers and images.
+  // Copies are staged in a persistently mapped ring and batched into one submission per flush, on the transfer
+  // only queue if the device has one. Every submission signals the next value of a timeline semaphore, which is
+  // both the ticket of its copies and what a frame drawing them waits for, see getSubmittedValue.
+  // Not thread safe, used from the render thread only.
+  class UploadManager {
+  public:
+    static constexpr VkDeviceSize STAGING_SIZE = 16 * 1024 * 1024;
+
+    // pool has to belong to the transfer queue family and allow resetting command buffers.
+    void create(const VkBackend::Instance &backend, VkCommandPool pool, VkDeviceSize stagingSize = STAGING_SIZE);
+    // The device has to be idle.
+    void destroy(const VkBackend::Instance &backend);
+
+    // Queues a copy of size bytes from data into dst at dstOffset. data can be freed right away.
+    // dst has to be device local and usable by the transfer queue, see Buffers::createDeviceBuffer.
+    UploadTicket uploadBuffer(const VkBackend::Instance &backend, const void *data, VkDeviceSize size, VkBuffer dst, VkDeviceSize dstOffset = 0);
+    // Queues the whole of dst, tightly packed texels rows top to bottom. dst ends in SHADER_READ_ONLY_OPTIMAL layout.
+    UploadTicket uploadImage(const VkBackend::Instance &backend, const void *texels, VkDeviceSize size, const Image &dst);
+
+    // Submits everything queued since the last flush as one submission.
+    void flush(const VkBackend::Instance &backend);
+    [[nodiscard]] bool isComplete(const VkBackend::Instance &backend, UploadTicket ticket) const;
+    // Flushes if ticket was not submitted yet and blocks until it has landed.
+    void wait(const VkBackend::Instance &backend, UploadTicket ticket);
+
+    [[nodiscard]] VkSemaphore getSemaphore() const;
+    // Value signaled by the last submission, 0 before the first one. Waiting for it covers every flushed upload.
+    [[nodiscard]] u64 getSubmittedValue() const;
+
+    struct Stats {
+      u64 bytes{0}; // Copied since creation
+      u64 copies{0};
+      u64 submissions{0};
+      u64 stalls{0}; // Uploads that had to wait for the staging ring to drain
+    };
+    [[nodiscard]] const Stats &getStats() const;
+
+  private:
+    // Submitted or being recorded. Staging is freed in submission order, bytes includes what wrapping skipped.
+    struct Batch {
+      VkCommandBuffer cmdBuffer{};
+      u64 value{0};
+      VkDeviceSize bytes{0};
+      std::vector<Buffers::Buffer> oversized{}; // Staging of uploads larger than the ring, freed with the batch
+    };
+
+    VkCommandPool pool{};
+    VkSemaphore timeline{};
+    Buffers::Buffer staging{};
+    u8 *mapped{nullptr};
+    VkDeviceSize capacity{0};
+    VkDeviceSize head{0}; // Next write
+    VkDeviceSize tail{0}; // Oldest byte still read by a submission
+    VkDeviceSize used{0};
+
+    std::deque<Batch> inFlight{};
+    Batch recording{};
+    bool recordingOpen{false};
+    std::vector<VkCommandBuffer> freeCmdBuffers{};
+    u64 submittedValue{0};
+    Stats stats{};
+
+    // Retires completed batches and returns their staging.
+    void reclaim(const VkBackend::Instance &backend);
+    bool tryAllocate(VkDeviceSize size, VkDeviceSize &offsetOut);
+    // Copies data into staging, waiting for earlier submissions if the ring is full. Returns the buffer and offset to copy from.
+    VkBuffer stage(const VkBackend::Instance &backend, const void *data, VkDeviceSize size, VkDeviceSize &offsetOut);
+    VkCommandBuffer recordingBuffer(const VkBackend::Instance &backend);
+  };
+
+}
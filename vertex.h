@@ -0,0 +1,131 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+#include <glm/gtc/type_precision.hpp>
+#include "vulkan/vulkan.h"
+
+#include "common.h"
+
+namespace VkBackend {
+
+  struct VertexInputDescription {
+    std::vector<VkVertexInputBindingDescription> bindings;
+    std::vector<VkVertexInputAttributeDescription> attributes;
+  };
+
+  // Maps the C++ type of a vertex member to the format the vertex fetch reads it with.
+  // Unsupported types fail to compile.
+  template <typename T> struct AttributeFormat;
+  template <> struct AttributeFormat<float> { static constexpr VkFormat value = VK_FORMAT_R32_SFLOAT; };
+  template <> struct AttributeFormat<u32> { static constexpr VkFormat value = VK_FORMAT_R32_UINT; };
+  template <> struct AttributeFormat<glm::vec2> { static constexpr VkFormat value = VK_FORMAT_R32G32_SFLOAT; };
+  template <> struct AttributeFormat<glm::vec4> { static constexpr VkFormat value = VK_FORMAT_R32G32B32A32_SFLOAT; };
+  template <> struct AttributeFormat<glm::i16vec2> { static constexpr VkFormat value = VK_FORMAT_R16G16_SSCALED; };
+  template <> struct AttributeFormat<VKUIX::Color> { static constexpr VkFormat value = VK_FORMAT_R8G8B8A8_UNORM; };
+
+  template <typename T>
+  constexpr VkVertexInputAttributeDescription attribute(const u32 location, const u32 offset) {
+    return {location, 0, AttributeFormat<T>::value, offset};
+  }
+
+  // Describes one member of a vertex struct, its format is deduced from the member type.
+#define VKUIX_VERTEX_ATTRIBUTE(VERTEX, MEMBER, LOCATION) \
+  VkBackend::attribute<decltype(VERTEX::MEMBER)>(LOCATION, offsetof(VERTEX, MEMBER))
+
+  // Specialised for every vertex format with its input rate and a constexpr std::array of attributes.
+  template <typename V> struct VertexLayout;
+
+  template <typename V>
+  VertexInputDescription describeVertex(const u32 binding = 0) {
+    VertexInputDescription description{};
+    description.bindings.push_back({binding, sizeof(V), VertexLayout<V>::inputRate});
+    for (VkVertexInputAttributeDescription attrib : VertexLayout<V>::attributes) {
+      attrib.binding = binding;
+      description.attributes.push_back(attrib);
+    }
+    return description;
+  }
+
+  // Default format, float positions and RGBA8 color.
+  struct Vertex {
+    glm::vec2 pos;
+    VKUIX::Color col;
+  };
+  static_assert(sizeof(Vertex) == 12);
+
+  template <> struct VertexLayout<Vertex> {
+    static constexpr VkVertexInputRate inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    static constexpr std::array attributes = {
+      VKUIX_VERTEX_ATTRIBUTE(Vertex, pos, 0),
+      VKUIX_VERTEX_ATTRIBUTE(Vertex, col, 1),
+    };
+  };
+
+  // Positions snapped to whole pixels in the range of an i16. Read by the same default.vert,
+  // SSCALED converts them back to floats in the vertex fetch.
+  struct QuantizedVertex {
+    glm::i16vec2 pos;
+    VKUIX::Color col;
+
+    static QuantizedVertex quantize(const Vertex &vertex) {
+      const glm::vec2 pos = glm::clamp(glm::round(vertex.pos), glm::vec2(INT16_MIN), glm::vec2(INT16_MAX));
+      return {glm::i16vec2{pos}, vertex.col};
+    }
+  };
+  static_assert(sizeof(QuantizedVertex) == 8);
+
+  template <> struct VertexLayout<QuantizedVertex> {
+    static constexpr VkVertexInputRate inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    static constexpr std::array attributes = {
+      VKUIX_VERTEX_ATTRIBUTE(QuantizedVertex, pos, 0),
+      VKUIX_VERTEX_ATTRIBUTE(QuantizedVertex, col, 1),
+    };
+  };
+
+  // One rounded rectangle of the instanced SDF path. Expanded to a quad in roundrect.vert,
+  // coverage is computed from a rounded box distance field in roundrect.frag.
+  struct RectInstance {
+    glm::vec4 bounds; // x, y, width, height
+    glm::vec4 radii; // topLeft, topRight, bottomLeft, bottomRight
+    VKUIX::Color color;
+    VKUIX::Color borderColor;
+    float borderWidth;
+    float pad;
+  };
+  static_assert(sizeof(RectInstance) == 48);
+
+  template <> struct VertexLayout<RectInstance> {
+    static constexpr VkVertexInputRate inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+    static constexpr std::array attributes = {
+      VKUIX_VERTEX_ATTRIBUTE(RectInstance, bounds, 0),
+      VKUIX_VERTEX_ATTRIBUTE(RectInstance, radii, 1),
+      VKUIX_VERTEX_ATTRIBUTE(RectInstance, color, 2),
+      VKUIX_VERTEX_ATTRIBUTE(RectInstance, borderColor, 3),
+      VKUIX_VERTEX_ATTRIBUTE(RectInstance, borderWidth, 4),
+    };
+  };
+
+  // One textured quad of RenderList::image and RenderList::text. Expanded to a quad in textured.vert,
+  // textured.frag multiplies the color with the texel of the texture table slot the instance names.
+  struct TexturedInstance {
+    glm::vec4 bounds; // x, y, width, height in pixels
+    glm::vec4 uv; // x, y, width, height, normalized
+    VKUIX::Color color;
+    u32 texture; // Slot in the texture table
+  };
+  static_assert(sizeof(TexturedInstance) == 40);
+
+  template <> struct VertexLayout<TexturedInstance> {
+    static constexpr VkVertexInputRate inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+    static constexpr std::array attributes = {
+      VKUIX_VERTEX_ATTRIBUTE(TexturedInstance, bounds, 0),
+      VKUIX_VERTEX_ATTRIBUTE(TexturedInstance, uv, 1),
+      VKUIX_VERTEX_ATTRIBUTE(TexturedInstance, color, 2),
+      VKUIX_VERTEX_ATTRIBUTE(TexturedInstance, texture, 3),
+    };
+  };
+
+} // namespace VkBackend
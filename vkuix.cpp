@@ -1,14 +1,206 @@
 #include "vkuix.h"
 
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <optional>
+
 #include <glm/ext/matrix_clip_space.hpp>
 
-#include "buffer.h"
+#include "profiler.h"
+
+// Initial size of one upload ring slice. Grows geometrically when a frame does not fit.
+static constexpr VkDeviceSize UPLOAD_SLICE_SIZE = 256 * 1024;
+
+// Upper bound of a latency limiter wait. A minimized window may not present at all, the limiter gives up instead of hanging.
+static constexpr u64 PRESENT_WAIT_TIMEOUT_NS = 100'000'000;
+
+// How often render() checks the pipeline cache for new pipelines to save.
+static constexpr std::chrono::seconds PIPELINE_CACHE_SAVE_INTERVAL{30};
+
+// Draws per layer buffer. Larger layers are split so their recording spreads over several workers.
+static constexpr u32 LAYER_DRAWS = 256;
+// Command recording threads besides the render thread.
+static constexpr u32 MAX_RECORD_THREADS = 7;
+
+// GPU zones. Only the first MAX_TIMED_BATCHES draw batches of a layer buffer get their own timestamps.
+static constexpr u32 FRAME_TIMESTAMPS = 16;
+static constexpr u32 MAX_TIMED_BATCHES = 32;
+static constexpr const char *ZONE_FRAME = "frame";
+static constexpr const char *ZONE_RENDERING = "rendering";
+static constexpr const char *ZONE_DRAWS = "draws";
+
+// Sample count mode asks for, or the closest lower one both color and depth attachments support.
+static VkSampleCountFlagBits chooseSamples(const VkBackend::Instance &backend, const VKUIX::AntiAliasing mode) {
+  VkSampleCountFlagBits samples;
+  switch (mode) {
+    case VKUIX::AntiAliasing::Msaa2: samples = VK_SAMPLE_COUNT_2_BIT; break;
+    case VKUIX::AntiAliasing::Msaa4: samples = VK_SAMPLE_COUNT_4_BIT; break;
+    case VKUIX::AntiAliasing::Msaa8: samples = VK_SAMPLE_COUNT_8_BIT; break;
+    default: return VK_SAMPLE_COUNT_1_BIT;
+  }
+  while (samples != VK_SAMPLE_COUNT_1_BIT && !(backend.colorSampleCounts & backend.depthSampleCounts & samples))
+    samples = static_cast<VkSampleCountFlagBits>(samples >> 1);
+  return samples;
+}
+
+static void applyAntiAliasing(VKUIX::Instance &instance, const VKUIX::AntiAliasing mode) {
+  instance.antiAliasing = mode;
+  instance.samples = chooseSamples(instance.backend, mode);
+  for (VkBackend::PipelineDesc &desc : instance.pipelineDescs) {
+    desc.samples = instance.samples;
+    desc.edgeAA = mode != VKUIX::AntiAliasing::Off;
+  }
+}
+
+// Replaces msaaImage and depthImage with ones for instance.samples, the caller retires the old ones, see retireAttachments.
+// Both are transient: the MSAA target is only resolved, depth only lives for one rendering. Single sampled rendering
+// has no MSAA target and draws straight into the target.
+static void createAttachments(VKUIX::Instance &instance, const VkExtent2D extent) {
+  instance.depthImage = {};
+  instance.depthImage.sampleCount = instance.samples;
+  instance.depthImage.extent = extent;
+  instance.depthImage.format = VkBackend::DEPTH_FORMAT;
+  instance.depthImage.usageFlags = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+  instance.depthImage.transient = true;
+  VkBackend::createImage(instance.backend, instance.depthImage);
+
+  instance.msaaImage = {};
+  if (instance.samples == VK_SAMPLE_COUNT_1_BIT) return;
+  instance.msaaImage.sampleCount = instance.samples;
+  instance.msaaImage.extent = extent;
+  instance.msaaImage.format = VkBackend::COLOR_FORMAT;
+  instance.msaaImage.transient = true;
+  VkBackend::createImage(instance.backend, instance.msaaImage);
+}
+
+static void retireAttachments(const VKUIX::Instance &instance, VkBackend::Retired &retired) {
+  retired.images.push_back(instance.depthImage);
+  if (instance.msaaImage.vkImage) retired.images.push_back(instance.msaaImage);
+}
+
+// Variant drawing the opaque pass of desc's draws, see VkBackend::PipelineDesc::opaquePass.
+static VkBackend::PipelineDesc opaqueVariant(VkBackend::PipelineDesc desc) {
+  desc.opaquePass = true;
+  desc.blend = VkBackend::BlendMode::Opaque;
+  return desc;
+}
 
 sptr<VKUIX::Window> VKUIX::createWindow(const char *title, Dim dimension) {
   return std::make_shared<VKUIX::Window>(title, dimension.width, dimension.height);
 }
 
-sptr<VKUIX::Instance> VKUIX::createInstance(const sptr<Window> &window, const std::vector<const char *> *additionalExtensions) {
+// Everything below the device that windowed and headless instances share.
+static void setupRenderer(VKUIX::Instance &instance, const VkExtent2D extent, const u32 frameCount) {
+  VKUIX_PROFILE_ZONE("setupRenderer");
+  VkBackend::createCommandpool(instance.backend, instance.cmdPool);
+  VkBackend::createCommandpool(instance.backend, instance.uploadPool,
+                               VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+                               instance.backend.queueFamilies.transferFamily);
+  instance.uploads.create(instance.backend, instance.uploadPool);
+
+  // The texture table is update after bind, its set has to come from a pool that allows it.
+  VkBackend::DescriptorPoolInfo poolInfo{.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT, .maxSets = 2};
+  poolInfo.sizes.push_back({VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1});
+  poolInfo.sizes.push_back({VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VKUIX::TextureTable::CAPACITY});
+  VkBackend::createDescriptorPool(instance.backend, poolInfo, instance.mainDescPool);
+
+  VkBackend::DescriptorSetLayoutInfo layoutInfo{};
+  VkBackend::createDescriptorLayout(instance.backend, layoutInfo, instance.descLayoutUniform);
+
+  VkBackend::DescriptorSetAllocInfo allocInfo{};
+  allocInfo.pPool = &instance.mainDescPool;
+  allocInfo.layouts = {instance.descLayoutUniform};
+  VkBackend::allocDescriptorSets(instance.backend, allocInfo, instance.mainDescriptor);
+
+  VkBackend::createSampler(instance.backend, VK_FILTER_LINEAR, instance.textureSampler);
+  instance.textures.create(instance.backend, instance.mainDescPool, instance.textureSampler);
+
+  // Glyph atlas, uploaded before its first use by recordAtlasUpload. The view reads the coverage as alpha
+  // of white texels, so text samples it like any other texture.
+  instance.glyphAtlas = std::make_unique<VKUIX::GlyphAtlas>();
+  instance.glyphAtlasImage.extent = {VKUIX::GlyphAtlas::SIZE, VKUIX::GlyphAtlas::SIZE};
+  instance.glyphAtlasImage.format = VK_FORMAT_R8_UNORM;
+  instance.glyphAtlasImage.usageFlags = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+  instance.glyphAtlasImage.swizzle = {VK_COMPONENT_SWIZZLE_ONE, VK_COMPONENT_SWIZZLE_ONE, VK_COMPONENT_SWIZZLE_ONE, VK_COMPONENT_SWIZZLE_R};
+  VkBackend::createImage(instance.backend, instance.glyphAtlasImage);
+  instance.glyphTexture = instance.textures.add(instance.backend, instance.glyphAtlasImage);
+
+  const auto pipelineStart = std::chrono::steady_clock::now();
+  VkBackend::setupPipelineRepository(instance.backend, {instance.descLayoutUniform, instance.textures.getLayout()});
+
+  VkBackend::PipelineDesc &trianglesDesc = instance.pipelineDescs[static_cast<u8>(VKUIX::PipelineId::Triangles)];
+  trianglesDesc.shader = "default";
+  trianglesDesc.vertexFormat = VkBackend::VertexFormat::Vertex;
+  trianglesDesc.blend = VkBackend::BlendMode::Alpha;
+
+  VkBackend::PipelineDesc &roundRectDesc = instance.pipelineDescs[static_cast<u8>(VKUIX::PipelineId::RoundRect)];
+  roundRectDesc.shader = "roundrect";
+  roundRectDesc.vertexFormat = VkBackend::VertexFormat::RectInstance;
+  roundRectDesc.blend = VkBackend::BlendMode::Alpha;
+
+  VkBackend::PipelineDesc &texturedDesc = instance.pipelineDescs[static_cast<u8>(VKUIX::PipelineId::Textured)];
+  texturedDesc.shader = "textured";
+  texturedDesc.vertexFormat = VkBackend::VertexFormat::TexturedInstance;
+  texturedDesc.blend = VkBackend::BlendMode::Alpha;
+
+  applyAntiAliasing(instance, instance.antiAliasing);
+
+  // The startup variants are what everything else falls back to, so these are waited for.
+  for (u32 i = 0; i < VKUIX::PIPELINE_ID_COUNT; ++i) {
+    instance.pipelines[i] = VkBackend::getPipeline(instance.backend, instance.pipelineDescs[i], false);
+    if (i != static_cast<u8>(VKUIX::PipelineId::Textured))
+      instance.opaquePipelines[i] = VkBackend::getPipeline(instance.backend, opaqueVariant(instance.pipelineDescs[i]), false);
+  }
+
+  // Compare against a run without the cache file to see what the cache saves.
+  const double pipelineMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - pipelineStart).count();
+  LOG(I, "Created pipelines in " << pipelineMs << " ms with a " << (instance.backend.pipelineCacheWarm ? "warm" : "cold") << " pipeline cache.");
+  VkBackend::savePipelineCache(instance.backend);
+  instance.pipelineCacheSaveTime = std::chrono::steady_clock::now();
+
+  const u32 hardwareThreads = std::thread::hardware_concurrency();
+  instance.workers = std::make_unique<VKUIX::TaskPool>(glm::min(hardwareThreads > 1 ? hardwareThreads - 1 : 0, MAX_RECORD_THREADS));
+
+  instance.renderFrames.resize(frameCount);
+  for (u32 i = 0; i < frameCount; ++i) {
+    VkBackend::createCommandbuffer(instance.backend, instance.cmdPool, instance.renderFrames[i].commandBuffer);
+    // One pool per worker and frame, so workers never share a pool and a frame's pools are only reset after its fence.
+    instance.renderFrames[i].recordPools.resize(instance.workers->getWorkerCount());
+    for (VkCommandPool &pool : instance.renderFrames[i].recordPools)
+      VkBackend::createCommandpool(instance.backend, pool);
+    VkBackend::createFence(instance.backend, instance.renderFrames[i].renderFence);
+    VkBackend::createSemaphore(instance.backend, instance.renderFrames[i].acquireSema);
+    VkBackend::createQueryPool(instance.backend, instance.renderFrames[i].queries, FRAME_TIMESTAMPS, false);
+  }
+
+  // Viewport
+  instance.viewport.width = static_cast<float>(extent.width);
+  instance.viewport.height = static_cast<float>(extent.height);
+  instance.viewport.maxDepth = 1.0f;
+  instance.viewport.minDepth = 0.0f;
+  instance.viewport.x = 0;
+  instance.viewport.y = 0;
+
+  createAttachments(instance, extent);
+
+  Buffers::createRingBuffer(instance.backend.allocator, instance.uploadRing, UPLOAD_SLICE_SIZE,
+                            instance.renderFrames.size(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+  // Every band dirty at once still fits, each rect only adds alignment.
+  Buffers::createRingBuffer(instance.backend.allocator, instance.glyphStaging,
+                            VKUIX::GlyphAtlas::SIZE * VKUIX::GlyphAtlas::SIZE + VKUIX::GlyphAtlas::BAND_COUNT * 16,
+                            instance.renderFrames.size(), VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+
+  instance.renderList = std::make_unique<VKUIX::RenderList>();
+  instance.renderList->setViewport(extent);
+  instance.renderList->setGlyphAtlas(instance.glyphAtlas.get(), instance.glyphTexture);
+  instance.renderLists = {instance.renderList.get()};
+}
+
+sptr<VKUIX::Instance> VKUIX::createInstance(const sptr<Window> &window, const std::vector<const char *> *additionalExtensions,
+                                            const u32 framesInFlight) {
+  VKUIX_PROFILE_ZONE("createInstance");
 
   sptr<VKUIX::Instance> instance = std::make_shared<VKUIX::Instance>();
 
@@ -22,144 +214,1008 @@ sptr<VKUIX::Instance> VKUIX::createInstance(const sptr<Window> &window, const st
   VkBackend::setupSurface(instance->backend, window->getWindowPtr()); // Setup Window VkSurfaceKHR
   VkBackend::setupDevices(instance->backend); // Choose best suitable physical rendering device
   VkBackend::setupVMA(instance->backend);
-  VkBackend::setupSwapchain(window, instance->backend, false);
+  VkBackend::setupSwapchain(window, instance->backend);
+  instance->swapchainWindowExtent = window->getExtent();
+  setupRenderer(*instance, instance->backend.swapchain.extent, glm::clamp(framesInFlight, 1u, MAX_FRAMES_IN_FLIGHT));
+  LOG(I, "Rendering with " << instance->renderFrames.size() << " frames in flight and "
+                           << instance->backend.swapchain.images.size() << " swapchain images.");
 
-  VkBackend::createCommandpool(instance->backend, instance->cmdPool);
-  VkBackend::createCommandpool(instance->backend, instance->uploadPool);
+  instance->incrementalPresent = VkBackend::hasDeviceExtension(instance->backend, VK_KHR_INCREMENTAL_PRESENT_EXTENSION_NAME);
+  instance->imageDamage.assign(instance->backend.swapchain.images.size(), VkRect2D{{0, 0}, instance->backend.swapchain.extent});
 
-  VkBackend::DescriptorPoolInfo poolInfo{.maxSets = 1};
-  poolInfo.sizes.push_back({VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1});
-  VkBackend::createDescriptorPool(instance->backend, poolInfo, instance->mainDescPool);
+  return instance;
+}
 
-  VkBackend::DescriptorSetLayoutInfo layoutInfo{};
-  VkBackend::createDescriptorLayout(instance->backend, layoutInfo, instance->descLayoutUniform);
+sptr<VKUIX::Instance> VKUIX::createHeadlessInstance(const VkExtent2D extent) {
+  VKUIX_PROFILE_ZONE("createHeadlessInstance");
 
-  VkBackend::DescriptorSetAllocInfo allocInfo{};
-  allocInfo.pPool = &instance->mainDescPool;
-  allocInfo.layouts = {instance->descLayoutUniform};
-  VkBackend::allocDescriptorSets(instance->backend, allocInfo, instance->mainDescriptor);
+  sptr<VKUIX::Instance> instance = std::make_shared<VKUIX::Instance>();
+  instance->headless = true;
 
-  Shader defaultShader{instance->backend.device, "default"};
+  VkBackend::setupInstance(instance->backend, VkBackend::getHeadlessInstanceExt());
+  VkBackend::setupDevices(instance->backend); // No surface, so no swapchain or present support is required
+  VkBackend::setupVMA(instance->backend);
 
-  std::vector pipelineLayouts = {instance->descLayoutUniform};
-  VkBackend::createDynamicGraphicsPipeline(instance->backend, defaultShader, pipelineLayouts, instance->defaultPipeline, instance->defaultPipelineLayout);
+  // Readback is synchronous, so a single frame is enough.
+  setupRenderer(*instance, extent, 1);
 
-  instance->renderFrames.reserve(instance->backend.swapchain.framebufferingAmount);
-  for (int i = 0; i < instance->backend.swapchain.framebufferingAmount; ++i) {
-    VkBackend::createCommandbuffer(instance->backend, instance->cmdPool, instance->renderFrames[i].commandBuffer);
-    VkBackend::createFence(instance->backend, instance->renderFrames[i].renderFence);
-    VkBackend::createSemaphore(instance->backend, instance->renderFrames[i].renderSema);
-    VkBackend::createSemaphore(instance->backend, instance->renderFrames[i].presentSema);
-  }
+  instance->offscreenTarget.extent = extent;
+  instance->offscreenTarget.format = VkBackend::COLOR_FORMAT;
+  instance->offscreenTarget.usageFlags = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+  VkBackend::createImage(instance->backend, instance->offscreenTarget);
 
-  // Viewport
-  instance->viewport.width = static_cast<float>(window->getExtent().width);
-  instance->viewport.height = static_cast<float>(window->getExtent().height);
-  instance->viewport.maxDepth = 1.0f;
-  instance->viewport.minDepth = 0.0f;
-  instance->viewport.x = 0;
-  instance->viewport.y = 0;
-
-  // Offscreen MSAA Antialiasing image
-  instance->msaaImage.sampleCount = VkBackend::ANTI_ALIASING_COUNT;
-  instance->msaaImage.extent = window->getExtent();
-  instance->msaaImage.format = VkBackend::COLOR_FORMAT;
-  VkBackend::createImage(instance->backend, instance->msaaImage);
-
-  instance->renderList = std::make_unique<RenderList>();
+  Buffers::createReadbackBuffer(instance->backend.allocator, instance->readback, static_cast<VkDeviceSize>(extent.width) * extent.height * 4);
+
+  LOG(S, "Created headless instance " << extent.width << "x" << extent.height << ".");
   return instance;
 }
 
+void VKUIX::destroyInstance(const sptr<Instance> &instance) {
+  const VkDevice device = instance->backend.device;
+  vkDeviceWaitIdle(device);
+
+  Buffers::destroyRingBuffer(instance->backend.allocator, instance->uploadRing);
+  instance->uploads.destroy(instance->backend);
+  Buffers::destroyRingBuffer(instance->backend.allocator, instance->glyphStaging);
+
+  for (VkBackend::RenderFrame &frame : instance->renderFrames) {
+    vkDestroyFence(device, frame.renderFence, nullptr);
+    vkDestroySemaphore(device, frame.acquireSema, nullptr);
+    VkBackend::destroyQueryPool(instance->backend, frame.queries);
+    for (VkBackend::LayerCommands &layer : frame.layers)
+      VkBackend::destroyQueryPool(instance->backend, layer.queries);
+    for (VkCommandPool pool : frame.recordPools) // Frees the layer buffers as well
+      vkDestroyCommandPool(device, pool, nullptr);
+  }
+  instance->renderFrames.clear();
+  instance->workers.reset();
+
+  vkDestroyCommandPool(device, instance->cmdPool, nullptr);
+  vkDestroyCommandPool(device, instance->uploadPool, nullptr);
+
+  instance->textures.destroy(instance->backend); // The glyph atlas image included
+  vkDestroySampler(device, instance->textureSampler, nullptr);
+
+  vkDestroyDescriptorPool(device, instance->mainDescPool, nullptr);
+  vkDestroyDescriptorSetLayout(device, instance->descLayoutUniform, nullptr);
+
+  if (instance->msaaImage.vkImage) {
+    vkDestroyImageView(device, instance->msaaImage.view, nullptr);
+    vmaDestroyImage(instance->backend.allocator, instance->msaaImage.vkImage, instance->msaaImage.alloc);
+  }
+  vkDestroyImageView(device, instance->depthImage.view, nullptr);
+  vmaDestroyImage(instance->backend.allocator, instance->depthImage.vkImage, instance->depthImage.alloc);
+  for (VkBackend::Retired &retired : instance->retired)
+    VkBackend::destroyRetired(instance->backend, retired);
+  instance->retired.clear();
+
+  if (instance->headless) {
+    vkDestroyImageView(device, instance->offscreenTarget.view, nullptr);
+    vmaDestroyImage(instance->backend.allocator, instance->offscreenTarget.vkImage, instance->offscreenTarget.alloc);
+    Buffers::destroyReadbackBuffer(instance->backend.allocator, instance->readback);
+  }
+
+  VkBackend::destroyInstance(instance->backend);
+}
+
 uptr<VKUIX::RenderList> &VKUIX::getRenderList(const sptr<Instance> &instance) {
   return instance->renderList;
 }
 
-void VKUIX::render(const sptr<Instance> &instance, const sptr<Window>& window) {
+void VKUIX::setRenderListShardCount(const sptr<Instance> &instance, const u32 count) {
+  std::vector<uptr<RenderList>> &shards = instance->renderListShards;
+  if (count == shards.size()) return;
+
+  const VkExtent2D extent{static_cast<u32>(instance->viewport.width), static_cast<u32>(instance->viewport.height)};
+  // New shards start with full damage. Removed ones leave their last content on screen, so damage everything.
+  if (count < shards.size()) instance->renderList->setViewport(extent);
+
+  const size_t previous = shards.size();
+  shards.resize(count);
+  for (size_t i = previous; i < count; ++i) {
+    shards[i] = std::make_unique<RenderList>();
+    shards[i]->setViewport(extent);
+    shards[i]->setGlyphAtlas(instance->glyphAtlas.get(), instance->glyphTexture);
+  }
+
+  instance->renderLists = {instance->renderList.get()};
+  for (const uptr<RenderList> &shard : shards) instance->renderLists.push_back(shard.get());
+}
+
+uptr<VKUIX::RenderList> &VKUIX::getRenderListShard(const sptr<Instance> &instance, const u32 shard) {
+  return instance->renderListShards.at(shard);
+}
+
+VKUIX::FontId VKUIX::loadFont(const sptr<Instance> &instance, const std::string &path) {
+  Font font{};
+  if (!font.loadFile(path)) return INVALID_FONT;
+  return instance->glyphAtlas->addFont(std::move(font));
+}
+
+VKUIX::TextureId VKUIX::createTexture(const sptr<Instance> &instance, const u32 width, const u32 height, const u8 *rgba,
+                                     UploadTicket *ticketOut) {
+  VKUIX_PROFILE_ZONE("createTexture");
+  if (width == 0 || height == 0 || !rgba) {
+    LOG(W, "createTexture without texels.");
+    return INVALID_TEXTURE;
+  }
+
+  Image image{};
+  image.extent = {width, height};
+  image.format = VK_FORMAT_R8G8B8A8_UNORM;
+  image.usageFlags = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+  image.uploadTarget = true;
+  VkBackend::createImage(instance->backend, image);
+
+  const TextureId texture = instance->textures.add(instance->backend, image);
+  if (texture == INVALID_TEXTURE) {
+    vkDestroyImageView(instance->backend.device, image.view, nullptr);
+    vmaDestroyImage(instance->backend.allocator, image.vkImage, image.alloc);
+    return INVALID_TEXTURE;
+  }
+
+  const UploadTicket ticket = instance->uploads.uploadImage(instance->backend, rgba, static_cast<VkDeviceSize>(width) * height * 4, image);
+  if (ticketOut) *ticketOut = ticket;
+  return texture;
+}
+
+void VKUIX::destroyTexture(const sptr<Instance> &instance, const TextureId texture) {
+  if (texture == instance->glyphTexture) {
+    LOG(W, "The glyph atlas texture is destroyed with its instance.");
+    return;
+  }
+  // Every submission so far may sample it, including cached layer buffers that are executed again. Its upload
+  // may still be queued, the next submission waits for that, so it has to complete as well.
+  instance->textures.retire(texture, instance->submittedFrames + 1);
+}
+
+Buffers::Buffer VKUIX::createDeviceBuffer(const sptr<Instance> &instance, const VkDeviceSize size, const VkBufferUsageFlags usage) {
+  const VkBackend::QueueFamilyInfo &families = instance->backend.queueFamilies;
+  Buffers::Buffer buffer{};
+  Buffers::createDeviceBuffer(instance->backend.allocator, buffer, size, usage,
+                              {families.graphicsFamily.value(), families.transferFamily.value()});
+  return buffer;
+}
+
+VKUIX::UploadTicket VKUIX::uploadBuffer(const sptr<Instance> &instance, const void *data, const VkDeviceSize size,
+                                        const VkBuffer dst, const VkDeviceSize dstOffset) {
+  return instance->uploads.uploadBuffer(instance->backend, data, size, dst, dstOffset);
+}
+
+bool VKUIX::uploadComplete(const sptr<Instance> &instance, const UploadTicket ticket) {
+  return instance->uploads.isComplete(instance->backend, ticket);
+}
 
-  Buffers::Buffer vertexBuffer{};
-  Buffers::createBuffer(instance->renderList->getVertices(), instance->backend.allocator, vertexBuffer, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
-  Buffers::mapBuffer(instance->renderList->getVertices(), vertexBuffer, instance->backend.allocator);
+void VKUIX::waitUpload(const sptr<Instance> &instance, const UploadTicket ticket) {
+  VKUIX_PROFILE_ZONE("waitUpload");
+  instance->uploads.wait(instance->backend, ticket);
+}
+
+// Damages the whole viewport of every RenderList and swapchain image, for changes that affect every pixel.
+// Keeps the number of images, recreateSwapchain resizes imageDamage first.
+static void redrawAll(VKUIX::Instance &instance) {
+  const VkExtent2D extent{static_cast<u32>(instance.viewport.width), static_cast<u32>(instance.viewport.height)};
+  for (VKUIX::RenderList *list : instance.renderLists)
+    list->setViewport(extent);
+  instance.imageDamage.assign(instance.imageDamage.size(), VkRect2D{{0, 0}, extent});
+}
+
+void VKUIX::setPipelineVariant(const sptr<Instance> &instance, const PipelineId pipeline, const VkBackend::PipelineDesc &desc) {
+  VkBackend::PipelineDesc &current = instance->pipelineDescs[static_cast<u8>(pipeline)];
+  // The RenderList decides the vertex data of a PipelineId, the variant has to read it as it is.
+  if (desc.vertexFormat != current.vertexFormat) {
+    LOG(W, "Pipeline variant " << desc.shader << " does not match the vertex format of its PipelineId.");
+    return;
+  }
+  current = desc;
+  current.samples = instance->samples; // Has to match the color target
+  current.opaquePass = false; // The opaque pass variant is derived from it
+  // Whatever the variant draws looks different now, also where nothing else changes.
+  redrawAll(*instance);
+}
+
+// Replaces the swapchain and everything sized after it without waiting for the frames in flight. They keep rendering into
+// the old images, which are destroyed with the old swapchain once releaseCompleted sees them completed.
+static void recreateSwapchain(VKUIX::Instance &instance, const sptr<VKUIX::Window> &window) {
+  VKUIX_PROFILE_ZONE("recreateSwapchain");
+  VkBackend::Retired retired{};
+  retired.frame = instance.submittedFrames;
+  VkBackend::setupSwapchain(window, instance.backend, &retired);
+  instance.swapchainWindowExtent = window->getExtent();
+
+  const VkExtent2D extent = instance.backend.swapchain.extent;
+  if (extent.width != instance.depthImage.extent.width || extent.height != instance.depthImage.extent.height) {
+    retireAttachments(instance, retired);
+    createAttachments(instance, extent);
+  }
+  instance.retired.push_back(std::move(retired));
+
+  instance.viewport.width = static_cast<float>(extent.width);
+  instance.viewport.height = static_cast<float>(extent.height);
+  // The new swapchain may have a different number of images, a change of present mode often does.
+  instance.imageDamage.resize(instance.backend.swapchain.images.size());
+  redrawAll(instance); // The new images hold nothing yet
+  instance.swapchainOutdated = false;
+}
+
+void VKUIX::setAntiAliasing(const sptr<Instance> &instance, const AntiAliasing mode) {
+  if (mode == instance->antiAliasing) return;
+
+  const VkSampleCountFlagBits previous = instance->samples;
+  applyAntiAliasing(*instance, mode);
+  if (instance->samples != previous) {
+    VkBackend::Retired retired{};
+    retired.frame = instance->submittedFrames;
+    retireAttachments(*instance, retired);
+    instance->retired.push_back(std::move(retired));
+    createAttachments(*instance, {static_cast<u32>(instance->viewport.width), static_cast<u32>(instance->viewport.height)});
+  }
+  // The recorded layers are invalidated by the changed pipelines, redrawAll makes sure they are drawn again.
+  redrawAll(*instance);
+  LOG(I, "Antialiasing with " << instance->samples << " samples per pixel, edge antialiasing " << (mode != AntiAliasing::Off) << ".");
+}
+
+VkSampleCountFlagBits VKUIX::getSampleCount(const sptr<Instance> &instance) {
+  return instance->samples;
+}
+
+void VKUIX::setPresentMode(const sptr<Instance> &instance, const sptr<Window> &window, const VkPresentModeKHR mode) {
+  if (instance->headless) {
+    LOG(W, "Headless instances do not present.");
+    return;
+  }
+  VkBackend::Swapchain &swapchain = instance->backend.swapchain;
+  if (swapchain.requestedPresentMode == mode) return;
+
+  swapchain.requestedPresentMode = mode;
+  recreateSwapchain(*instance, window);
+  LOG(I, "Presenting with mode " << swapchain.presentMode << " and " << swapchain.images.size() << " swapchain images.");
+}
+
+VkPresentModeKHR VKUIX::getPresentMode(const sptr<Instance> &instance) {
+  return instance->backend.swapchain.presentMode;
+}
+
+void VKUIX::setMaxQueuedFrames(const sptr<Instance> &instance, const u32 frames) {
+  instance->maxQueuedFrames = frames;
+}
+
+// Whether the last submission of frame was presented, or completed on the GPU without present wait. Waits up to timeoutNs.
+// The first time it is, its submit to present time goes into the stats.
+static bool observePresent(VKUIX::Instance &instance, VkBackend::RenderFrame &frame, const u64 timeoutNs) {
+  if (frame.presentObserved) return true;
+
+  const VkBackend::Instance &backend = instance.backend;
+  // Ids presented to an earlier swapchain can not be waited for anymore, its recreation waited for the device anyway.
+  const bool presentWait = backend.waitForPresent && frame.presentId >= backend.swapchain.firstPresentId;
+  const VkResult result = presentWait
+    ? backend.waitForPresent(backend.device, backend.swapchain.swapchain, frame.presentId, timeoutNs)
+    : vkWaitForFences(backend.device, 1, &frame.renderFence, VK_TRUE, timeoutNs);
+  if (result != VK_SUCCESS) return false;
+
+  frame.presentObserved = true;
+  instance.stats.submitToPresentMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frame.submitTime).count();
+  instance.stats.presentWaitTiming = presentWait;
+  return true;
+}
+
+void VKUIX::waitForFrameLatency(const sptr<Instance> &instance) {
+  if (instance->latencyWaited || instance->headless) return;
+  VKUIX_PROFILE_ZONE("waitForFrameLatency");
+
+  const u32 frameCount = instance->renderFrames.size();
+  if (instance->maxQueuedFrames > 0) {
+    // Slots are used round robin, so the submission maxQueuedFrames ago belongs to this slot.
+    const u32 queued = glm::min(instance->maxQueuedFrames, frameCount);
+    VkBackend::RenderFrame &limit = instance->renderFrames[(instance->frameIndex + frameCount - queued) % frameCount];
+    observePresent(*instance, limit, PRESENT_WAIT_TIMEOUT_NS);
+  }
+  // Oldest first, so the stats end up with the latest submission that is done.
+  for (u32 i = 0; i < frameCount; ++i)
+    observePresent(*instance, instance->renderFrames[(instance->frameIndex + i) % frameCount], 0);
+
+  instance->latencyWaited = true;
+  instance->inputTime = std::chrono::steady_clock::now();
+}
+
+const VKUIX::FrameStats &VKUIX::getFrameStats(const sptr<Instance> &instance) {
+  return instance->stats;
+}
+
+static u64 renderListsHash(const VKUIX::Instance &instance) {
+  u64 hash = 0;
+  for (const VKUIX::RenderList *list : instance.renderLists)
+    hash = (hash ^ list->getHash()) * 0x100000001b3ull;
+  return hash;
+}
+
+// Ends the frame for the RenderLists and the glyph atlas, whether it was drawn or skipped.
+static void clearRenderLists(const VKUIX::Instance &instance) {
+  for (VKUIX::RenderList *list : instance.renderLists)
+    list->clear();
+  instance.glyphAtlas->nextFrame();
+}
+
+// Releases destroyed textures and retired swapchain objects no submission uses anymore. Called once the current frame's
+// fence has signaled, which completes every submission up to and including the frame's previous one, renderFrames.size()
+// submissions ago.
+static void releaseCompleted(VKUIX::Instance &instance) {
+  const u64 inFlight = instance.renderFrames.size() - 1;
+  const u64 completedFrames = instance.submittedFrames > inFlight ? instance.submittedFrames - inFlight : 0;
+  instance.textures.collect(instance.backend, completedFrames);
+  instance.stats.textures = instance.textures.getCount();
+
+  const auto pending = std::find_if(instance.retired.begin(), instance.retired.end(), [completedFrames](const VkBackend::Retired &entry) {
+    return entry.frame > completedFrames;
+  });
+  for (auto it = instance.retired.begin(); it != pending; ++it)
+    VkBackend::destroyRetired(instance.backend, *it);
+  instance.retired.erase(instance.retired.begin(), pending);
+}
+
+// Semaphores a frame submission waits for, kept alive until vkQueueSubmit.
+struct FrameWaits {
+  std::vector<VkSemaphore> semaphores{};
+  std::vector<VkPipelineStageFlags> stages{};
+  std::vector<u64> values{}; // Ignored for binary semaphores
+  VkTimelineSemaphoreSubmitInfo timelineInfo{VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO};
+};
+
+// Submits the queued uploads and makes the frame wait for every upload flushed so far, before vertex input
+// and fragment shaders read them. Waiting for a value that already signaled costs nothing.
+static void waitForUploads(VKUIX::Instance &instance, FrameWaits &waits, VkSubmitInfo &submitInfo) {
+  instance.uploads.flush(instance.backend);
+  instance.stats.transfers = instance.uploads.getStats();
+  if (const u64 value = instance.uploads.getSubmittedValue(); value > 0) {
+    waits.semaphores.push_back(instance.uploads.getSemaphore());
+    waits.stages.push_back(VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+    waits.values.push_back(value);
+  }
+
+  waits.timelineInfo.waitSemaphoreValueCount = waits.values.size();
+  waits.timelineInfo.pWaitSemaphoreValues = waits.values.data();
+  submitInfo.pNext = &waits.timelineInfo;
+  submitInfo.waitSemaphoreCount = waits.semaphores.size();
+  submitInfo.pWaitSemaphores = waits.semaphores.data();
+  submitInfo.pWaitDstStageMask = waits.stages.data();
+}
+
+static bool sameRect(const VkRect2D &a, const VkRect2D &b) {
+  return a.offset.x == b.offset.x && a.offset.y == b.offset.y && a.extent.width == b.extent.width && a.extent.height == b.extent.height;
+}
+
+static bool emptyRect(const VkRect2D &rect) {
+  return rect.extent.width == 0 || rect.extent.height == 0;
+}
+
+static VkRect2D unionRect(const VkRect2D &a, const VkRect2D &b) {
+  if (emptyRect(a)) return b;
+  if (emptyRect(b)) return a;
+  const int32_t x0 = glm::min(a.offset.x, b.offset.x);
+  const int32_t y0 = glm::min(a.offset.y, b.offset.y);
+  const int32_t x1 = glm::max(a.offset.x + static_cast<int32_t>(a.extent.width), b.offset.x + static_cast<int32_t>(b.extent.width));
+  const int32_t y1 = glm::max(a.offset.y + static_cast<int32_t>(a.extent.height), b.offset.y + static_cast<int32_t>(b.extent.height));
+  return {{x0, y0}, {static_cast<u32>(x1 - x0), static_cast<u32>(y1 - y0)}};
+}
+
+static VkRect2D intersectRect(const VkRect2D &a, const VkRect2D &b) {
+  const int32_t x0 = glm::max(a.offset.x, b.offset.x);
+  const int32_t y0 = glm::max(a.offset.y, b.offset.y);
+  const int32_t x1 = glm::min(a.offset.x + static_cast<int32_t>(a.extent.width), b.offset.x + static_cast<int32_t>(b.extent.width));
+  const int32_t y1 = glm::min(a.offset.y + static_cast<int32_t>(a.extent.height), b.offset.y + static_cast<int32_t>(b.extent.height));
+  if (x1 <= x0 || y1 <= y0) return {{x0, y0}, {0, 0}};
+  return {{x0, y0}, {static_cast<u32>(x1 - x0), static_cast<u32>(y1 - y0)}};
+}
 
+static VkRect2D renderListsDamage(const VKUIX::Instance &instance) {
+  VkRect2D damage{};
+  for (const VKUIX::RenderList *list : instance.renderLists)
+    damage = unionRect(damage, list->getDamage());
+  return damage;
+}
+
+// Makes sure a single ring slice can hold bytes. Growing drops every slice,
+// so all frames in flight have to retire first. Geometric growth keeps this rare.
+static void reserveUpload(VKUIX::Instance &instance, const VkDeviceSize bytes) {
+  if (Buffers::ringFits(instance.uploadRing, bytes)) return;
+  VKUIX_PROFILE_ZONE("render.growUploadRing");
+
+  std::vector<VkFence> fences{};
+  fences.reserve(instance.renderFrames.size());
+  for (const VkBackend::RenderFrame &frame : instance.renderFrames)
+    fences.push_back(frame.renderFence);
+  vkWaitForFences(instance.backend.device, fences.size(), fences.data(), VK_TRUE, UINT64_MAX);
+
+  Buffers::growRingBuffer(instance.backend.allocator, instance.uploadRing, bytes);
+
+  // Cached layer buffers point into the old ring.
+  for (VkBackend::RenderFrame &frame : instance.renderFrames) {
+    frame.contentValid = false;
+    for (VkBackend::LayerCommands &layer : frame.layers) layer.valid = false;
+  }
+}
+
+// Scissor a draw is recorded with. Rendering outside the render area is undefined, so clip scissors are clamped to it.
+static VkRect2D drawScissor(const VKUIX::Instance &instance, const VKUIX::MergedDraw &draw, const VkRect2D &renderArea) {
+  return draw.scissor == 0 ? renderArea : intersectRect(instance.renderLists[draw.list]->getScissors()[draw.scissor], renderArea);
+}
+
+// Pipeline a scheduled draw is recorded with.
+static VkPipeline drawPipeline(const VKUIX::Instance &instance, const VKUIX::MergedDraw &draw, const VKUIX::DrawPass pass) {
+  const u8 id = static_cast<u8>(draw.pipeline);
+  return pass == VKUIX::DrawPass::Opaque ? instance.opaquePipelines[id] : instance.pipelines[id];
+}
+
+// Model matrix that moves a draw to its depth. glm::ortho maps z to -z in clip space. roundrect.vert moves every instance
+// one depthStep nearer by gl_InstanceIndex, which counts from firstInstance, so that part of the offset is taken back here.
+static glm::mat4 depthModel(const VKUIX::Instance &instance, const VKUIX::MergedDraw &draw) {
+  float depth = draw.depth;
+  if (draw.pipeline == VKUIX::PipelineId::RoundRect) depth += static_cast<float>(draw.firstInstance) * instance.batcher.depthStep;
+  glm::mat4 model{1.0f};
+  model[3][2] = -depth;
+  return model;
+}
+
+// Issues the scheduled draws [begin, end) of the last DrawBatcher::build, only touching state that changed between draws.
+// Every draw has its own depth, pushed as the model matrix.
+static void recordDraws(const VKUIX::Instance &instance, VkCommandBuffer cmdBuffer, const VkRect2D &renderArea,
+                        const VkBackend::DefaultPushConstant &pushConstant, VkBackend::QueryPool &queries,
+                        const u32 begin, const u32 end) {
+  const VKUIX::DrawBatcher &batcher = instance.batcher;
+  const VkBuffer buffer = instance.uploadRing.buffer.buffer;
+
+  const VkPipelineLayout layout = instance.backend.pipelineRepository->layout;
+
+  std::optional<VkPipeline> boundPipeline{};
+  std::optional<u32> boundScissor{}; // List in the high half, 0 for the full render area
+  std::optional<VkIndexType> boundIndexType{};
+
+  // Every pipeline shares the layout, so the texture table and the push constants stay bound across pipeline changes.
+  const VkDescriptorSet textureSet = instance.textures.getSet();
+  vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 1, 1, &textureSet, 0, nullptr);
+  vkCmdPushConstants(cmdBuffer, layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(VkBackend::DefaultPushConstant), &pushConstant);
+
+  for (u32 i = begin; i < end; ++i) {
+    const VKUIX::ScheduledDraw &scheduled = batcher.getSchedule()[i];
+    const VKUIX::MergedDraw &draw = batcher.getDraws()[scheduled.draw];
+    const bool opaquePass = scheduled.pass == VKUIX::DrawPass::Opaque;
+    const VkPipeline pipeline = drawPipeline(instance, draw, scheduled.pass);
+    if (!pipeline) continue; // The variant failed to compile and nothing could stand in
+    if (boundPipeline != pipeline) {
+      VkDeviceSize vertexOffset = batcher.vertexOffset;
+      if (draw.pipeline == VKUIX::PipelineId::RoundRect) vertexOffset = batcher.instanceOffset;
+      if (draw.pipeline == VKUIX::PipelineId::Textured) vertexOffset = batcher.texturedOffset;
+
+      vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+      vkCmdBindVertexBuffers(cmdBuffer, 0, 1, &buffer, &vertexOffset);
+      boundPipeline = pipeline;
+    }
+
+    const u32 scissorId = draw.scissor == 0 ? 0 : static_cast<u32>(draw.list) << 16 | draw.scissor;
+    if (boundScissor != scissorId) {
+      const VkRect2D scissor = drawScissor(instance, draw, renderArea);
+      vkCmdSetScissor(cmdBuffer, 0, 1, &scissor);
+      boundScissor = scissorId;
+    }
+
+    const glm::mat4 model = depthModel(instance, draw);
+    vkCmdPushConstants(cmdBuffer, layout, VK_SHADER_STAGE_VERTEX_BIT, offsetof(VkBackend::DefaultPushConstant, model), sizeof(glm::mat4), &model);
+
+    if (draw.pipeline != VKUIX::PipelineId::Triangles) {
+      const char *zone = draw.pipeline == VKUIX::PipelineId::Textured ? "batch.textured" : opaquePass ? "batch.opaque.roundRect" : "batch.roundRect";
+      VkBackend::beginGpuZone(instance.backend, cmdBuffer, queries, zone);
+      vkCmdDraw(cmdBuffer, 6, draw.instanceCount, 0, draw.firstInstance);
+      VkBackend::endGpuZone(instance.backend, cmdBuffer, queries);
+      continue;
+    }
+
+    if (boundIndexType != draw.indexType) {
+      const VkDeviceSize indexOffset = draw.indexType == VK_INDEX_TYPE_UINT16 ? batcher.index16Offset : batcher.index32Offset;
+      vkCmdBindIndexBuffer(cmdBuffer, buffer, indexOffset, draw.indexType);
+      boundIndexType = draw.indexType;
+    }
+    VkBackend::beginGpuZone(instance.backend, cmdBuffer, queries, opaquePass ? "batch.opaque.triangles" : "batch.triangles");
+    vkCmdDrawIndexed(cmdBuffer, draw.indexCount, 1, draw.firstIndex, draw.vertexOffset, 0);
+    VkBackend::endGpuZone(instance.backend, cmdBuffer, queries);
+  }
+}
+
+// Uploads the RenderList into this frame's ring slice. The frame's fence must have been waited on.
+static void uploadContent(VKUIX::Instance &instance) {
+  VKUIX_PROFILE_ZONE("render.upload");
+  Buffers::RingBuffer &uploadRing = instance.uploadRing;
+  reserveUpload(instance, VKUIX::DrawBatcher::uploadSize(instance.renderLists));
+  Buffers::beginRingSlice(uploadRing, instance.frameIndex);
+  instance.batcher.build(instance.renderLists, uploadRing);
+  Buffers::flushRingSlice(instance.backend.allocator, uploadRing);
+
+  instance.stats.uploadBytes = uploadRing.cursor;
+  instance.stats.uploadCapacity = uploadRing.sliceSize;
+  instance.stats.uploadHighWaterMark = uploadRing.highWaterMark;
+  instance.stats.uploadGrowCount = uploadRing.growCount;
+  instance.stats.drawCommands = instance.batcher.getStats().commands;
+  instance.stats.drawCalls = instance.batcher.getSchedule().size();
+  instance.stats.mergedDraws = instance.batcher.getStats().merged;
+  instance.stats.opaqueDraws = instance.batcher.getStats().opaque;
+  instance.stats.culledPrimitives = 0;
+  for (const VKUIX::RenderList *list : instance.renderLists)
+    instance.stats.culledPrimitives += list->getCulledCount();
+}
+
+// Splits the draw schedule into contiguous ranges for the layer buffers. Each pass is sorted by layer,
+// so every layer of a pass is one range. Layers with more than LAYER_DRAWS draws are split further to spread them over workers.
+static void splitLayers(const VKUIX::Instance &instance, std::vector<std::pair<u32, u32>> &rangesOut) {
+  const std::vector<VKUIX::MergedDraw> &draws = instance.batcher.getDraws();
+  const std::vector<VKUIX::ScheduledDraw> &schedule = instance.batcher.getSchedule();
+  rangesOut.clear();
+  for (u32 i = 0; i < schedule.size(); ++i) {
+    const VKUIX::ScheduledDraw &first = schedule[rangesOut.empty() ? 0 : rangesOut.back().first];
+    if (rangesOut.empty() || schedule[i].pass != first.pass || draws[schedule[i].draw].layer != draws[first.draw].layer ||
+        i - rangesOut.back().first == LAYER_DRAWS)
+      rangesOut.push_back({i, i});
+    rangesOut.back().second = i + 1;
+  }
+}
+
+// Hash of everything recordDraws writes for the draws [begin, end). Ring offsets are part of it, so a layer
+// whose data moved because an earlier layer grew or shrank is re-recorded even if its own draws are the same.
+static u64 layerHash(const VKUIX::Instance &instance, const VkRect2D &renderArea, const u32 begin, const u32 end) {
+  u64 hash = 0xcbf29ce484222325ull;
+  const auto mix = [&hash](const std::initializer_list<u64> words) {
+    for (const u64 word : words) hash = (hash ^ word) * 0x100000001b3ull;
+  };
+
+  const VKUIX::DrawBatcher &batcher = instance.batcher;
+  mix({reinterpret_cast<u64>(instance.uploadRing.buffer.buffer), batcher.vertexOffset, batcher.index16Offset, batcher.index32Offset, batcher.instanceOffset, batcher.texturedOffset});
+  mix({std::bit_cast<u32>(batcher.depthStep)});
+  mix({static_cast<u64>(renderArea.offset.x), static_cast<u64>(renderArea.offset.y), renderArea.extent.width, renderArea.extent.height});
+  mix({static_cast<u64>(instance.viewport.width), static_cast<u64>(instance.viewport.height)});
+
+  for (u32 i = begin; i < end; ++i) {
+    const VKUIX::ScheduledDraw &scheduled = batcher.getSchedule()[i];
+    const VKUIX::MergedDraw &draw = batcher.getDraws()[scheduled.draw];
+    const VkRect2D scissor = drawScissor(instance, draw, renderArea);
+    mix({reinterpret_cast<u64>(drawPipeline(instance, draw, scheduled.pass)), static_cast<u64>(draw.indexType), std::bit_cast<u32>(draw.depth),
+         static_cast<u64>(scissor.offset.x), static_cast<u64>(scissor.offset.y), scissor.extent.width, scissor.extent.height,
+         draw.firstIndex, draw.indexCount, static_cast<u64>(draw.vertexOffset), draw.firstInstance, draw.instanceCount});
+  }
+  return hash;
+}
+
+// Records the scheduled draws [begin, end) into a layer's secondary buffer. Layers only depend on the ring slice
+// and the render area, not on the swapchain image, so they can be re-executed while their draws are unchanged.
+// Runs on a worker thread and only touches the layer and the pool it was allocated from.
+static void recordLayer(const VKUIX::Instance &instance, VkBackend::LayerCommands &layer, const VkRect2D &renderArea,
+                        const u32 begin, const u32 end) {
+  VKUIX_PROFILE_ZONE("render.recordLayer");
   VkBackend::DefaultPushConstant pushConstant{};
-  pushConstant.proj = glm::ortho(0.0f, instance->viewport.width, 0.0f, instance->viewport.height, -1.0f, 1.0f);
+  pushConstant.proj = glm::ortho(0.0f, instance.viewport.width, 0.0f, instance.viewport.height, -1.0f, 1.0f);
   pushConstant.model = glm::mat4(1.0f);
-  // pushConstant.model = glm::translate(pushConstant.model, glm::vec3{10.0f, 0.0f, 0.0f});
+  pushConstant.depthStep = instance.batcher.depthStep;
 
-  VkFence &renderFence = instance->renderFrames[instance->frameIndex].renderFence;
-  VkSemaphore &renderSema = instance->renderFrames[instance->frameIndex].renderSema;
-  VkSemaphore &presentSema = instance->renderFrames[instance->frameIndex].presentSema;
-  VkCommandBuffer &cmdBuffer = instance->renderFrames[instance->frameIndex].commandBuffer;
-  VkImageView &swapchainImageView = instance->backend.swapchain.images[instance->frameIndex].view;
+  VkCommandBufferInheritanceRenderingInfo inheritRendering{VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO};
+  inheritRendering.colorAttachmentCount = 1;
+  inheritRendering.pColorAttachmentFormats = &VkBackend::COLOR_FORMAT;
+  inheritRendering.depthAttachmentFormat = VkBackend::DEPTH_FORMAT;
+  inheritRendering.rasterizationSamples = instance.samples;
 
-  vkWaitForFences(instance->backend.device, 1, &renderFence, VK_TRUE, UINT64_MAX);
-  u32 swapchainImageIndex;
-  vkAcquireNextImageKHR(instance->backend.device, instance->backend.swapchain.swapchain, UINT64_MAX, presentSema, nullptr, &swapchainImageIndex);
-  vkResetFences(instance->backend.device, 1, &renderFence);
+  VkCommandBufferInheritanceInfo inheritInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO};
+  inheritInfo.pNext = &inheritRendering;
+
+  VkCommandBufferBeginInfo cmdBegin{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+  cmdBegin.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+  cmdBegin.pInheritanceInfo = &inheritInfo;
+
+  VkBackend::QueryPool &queries = layer.queries;
+  VkBackend::clearQueryZones(queries);
+
+  vkResetCommandBuffer(layer.buffer, 0);
+  vkBeginCommandBuffer(layer.buffer, &cmdBegin);
+  VkBackend::beginPipelineStatistics(layer.buffer, queries);
+  VkBackend::beginGpuZone(instance.backend, layer.buffer, queries, ZONE_DRAWS);
+  vkCmdSetViewport(layer.buffer, 0, 1, &instance.viewport);
+  recordDraws(instance, layer.buffer, renderArea, pushConstant, queries, begin, end);
+  VkBackend::endGpuZone(instance.backend, layer.buffer, queries);
+  VkBackend::endPipelineStatistics(layer.buffer, queries);
+  vkEndCommandBuffer(layer.buffer);
+}
+
+// Brings the frame's layer buffers up to date with the last upload. Layers whose hash still matches keep
+// their recording, the others are recorded in parallel, each by the worker owning its command pool.
+static void recordLayers(VKUIX::Instance &instance, VkBackend::RenderFrame &frame, const VkRect2D &renderArea) {
+  VKUIX_PROFILE_ZONE("render.recordLayers");
+  std::vector<std::pair<u32, u32>> ranges{};
+  splitLayers(instance, ranges);
+
+  // Command pools are not thread safe, so new buffers are allocated here before any worker starts.
+  while (frame.layers.size() < ranges.size()) {
+    VkBackend::LayerCommands &layer = frame.layers.emplace_back();
+    const VkCommandPool pool = frame.recordPools[(frame.layers.size() - 1) % frame.recordPools.size()];
+    VkBackend::createCommandbuffer(instance.backend, pool, layer.buffer, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+    VkBackend::createQueryPool(instance.backend, layer.queries, 2 * MAX_TIMED_BATCHES + 2, true);
+  }
+  frame.layerCount = ranges.size();
+
+  std::vector<u32> stale{};
+  for (u32 i = 0; i < ranges.size(); ++i) {
+    VkBackend::LayerCommands &layer = frame.layers[i];
+    const u64 hash = layerHash(instance, renderArea, ranges[i].first, ranges[i].second);
+    if (layer.valid && layer.hash == hash) continue;
+    layer.hash = hash;
+    layer.valid = true;
+    stale.push_back(i);
+  }
+  instance.stats.recordedLayers = stale.size();
+  instance.stats.reusedLayers = ranges.size() - stale.size();
+
+  // Layer i has to be recorded by worker i % workerCount, the owner of its pool, so items are layer indices.
+  instance.workers->parallelFor(stale.empty() ? 0 : stale.back() + 1, [&](const u32 item, u32) {
+    if (!std::binary_search(stale.begin(), stale.end(), item)) return;
+    recordLayer(instance, frame.layers[item], renderArea, ranges[item].first, ranges[item].second);
+  });
+}
+
+// Resolves the variant of every PipelineId through the repository. Returns true if any handle changed since the last call,
+// a compiled variant replacing its fallback for example, which changes how every pixel it draws looks.
+static bool resolvePipelines(VKUIX::Instance &instance) {
+  bool changed = false;
+  for (u32 i = 0; i < VKUIX::PIPELINE_ID_COUNT; ++i) {
+    const VkPipeline pipeline = VkBackend::getPipeline(instance.backend, instance.pipelineDescs[i]);
+    changed |= pipeline != instance.pipelines[i];
+    instance.pipelines[i] = pipeline;
+    if (i == static_cast<u8>(VKUIX::PipelineId::Textured)) continue;
+    const VkPipeline opaque = VkBackend::getPipeline(instance.backend, opaqueVariant(instance.pipelineDescs[i]));
+    changed |= opaque != instance.opaquePipelines[i];
+    instance.opaquePipelines[i] = opaque;
+  }
+  return changed;
+}
+
+// Makes sure the frame's layer buffers hold the draws of the current RenderLists for renderArea.
+// The fence guarantees the GPU is done with this frame's ring slice and layer buffers.
+// If the RenderLists and render area match what this frame recorded last time, both are reused as they are.
+static void prepareContent(VKUIX::Instance &instance, VkBackend::RenderFrame &frame, const VkRect2D &renderArea) {
+  // A fallback is swapped for its variant as soon as that compiled, the changed handle invalidates the recordings.
+  u64 contentHash = renderListsHash(instance);
+  for (u32 i = 0; i < VKUIX::PIPELINE_ID_COUNT; ++i) {
+    contentHash = (contentHash ^ reinterpret_cast<u64>(instance.pipelines[i])) * 0x100000001b3ull;
+    contentHash = (contentHash ^ reinterpret_cast<u64>(instance.opaquePipelines[i])) * 0x100000001b3ull;
+  }
+  if (frame.contentValid && frame.contentHash == contentHash && sameRect(frame.contentArea, renderArea)) {
+    instance.stats.cacheHits++;
+    instance.stats.cacheTimeSavedMs += instance.stats.cacheMissCostMs;
+    instance.stats.uploadBytes = 0;
+    instance.stats.recordedLayers = 0;
+    instance.stats.reusedLayers = frame.layerCount;
+  } else {
+    const auto start = std::chrono::steady_clock::now();
+    uploadContent(instance);
+    recordLayers(instance, frame, renderArea);
+    frame.contentHash = contentHash;
+    frame.contentArea = renderArea;
+    frame.contentValid = true;
+
+    // Running average of what a miss costs, credited to cacheTimeSavedMs on every hit.
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    instance.stats.cacheMissCostMs = instance.stats.cacheMisses == 0 ? ms : instance.stats.cacheMissCostMs * 0.9 + ms * 0.1;
+    instance.stats.cacheMisses++;
+  }
+}
+
+// Copies what the glyph atlas rasterized since the last upload into the atlas image, ahead of the rendering.
+// Runs for every recorded frame, cached layers included: they may draw glyphs that were evicted and rasterized again.
+// The barrier waits for the sampling of earlier submissions, so bands they still read are only overwritten after them.
+static void recordAtlasUpload(VKUIX::Instance &instance, VkCommandBuffer cmdBuffer, VkBackend::RenderFrame &frame) {
+  std::vector<VkRect2D> dirty{};
+  instance.glyphAtlas->takeDirty(dirty);
+  instance.stats.glyphs = instance.glyphAtlas->getStats();
+  instance.stats.glyphUploadRects = dirty.size();
+  if (dirty.empty()) return;
+  VKUIX_PROFILE_ZONE("render.uploadGlyphs");
+
+  // The first upload covers the whole atlas, before it the image holds nothing worth keeping.
+  const bool initial = dirty.size() == 1 && dirty[0].extent.width == VKUIX::GlyphAtlas::SIZE && dirty[0].extent.height == VKUIX::GlyphAtlas::SIZE;
+
+  Buffers::RingBuffer &staging = instance.glyphStaging;
+  Buffers::beginRingSlice(staging, instance.frameIndex);
+  const u8 *pixels = instance.glyphAtlas->getPixels();
+  std::vector<VkBufferImageCopy> regions{};
+  regions.reserve(dirty.size());
+  for (const VkRect2D &rect : dirty) {
+    const VkDeviceSize offset = Buffers::allocRing(staging, static_cast<VkDeviceSize>(rect.extent.width) * rect.extent.height);
+    for (u32 row = 0; row < rect.extent.height; ++row)
+      memcpy(staging.mapped + offset + static_cast<VkDeviceSize>(row) * rect.extent.width,
+             pixels + static_cast<size_t>(rect.offset.y + row) * VKUIX::GlyphAtlas::SIZE + rect.offset.x, rect.extent.width);
+
+    VkBufferImageCopy region{};
+    region.bufferOffset = offset;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.layerCount = 1;
+    region.imageOffset = {rect.offset.x, rect.offset.y, 0};
+    region.imageExtent = {rect.extent.width, rect.extent.height, 1};
+    regions.push_back(region);
+  }
+  Buffers::flushRingSlice(instance.backend.allocator, staging);
+
+  VkBackend::beginGpuZone(instance.backend, cmdBuffer, frame.queries, "copy.glyphs");
+  VkBackend::transitionImage(cmdBuffer, instance.glyphAtlasImage.vkImage,
+                             VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, 0,
+                             VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                             initial ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+  vkCmdCopyBufferToImage(cmdBuffer, staging.buffer.buffer, instance.glyphAtlasImage.vkImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                         regions.size(), regions.data());
+  VkBackend::transitionImage(cmdBuffer, instance.glyphAtlasImage.vkImage,
+                             VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                             VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+                             VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+  VkBackend::endGpuZone(instance.backend, cmdBuffer, frame.queries);
+}
+
+// Clears renderArea, executes the frame's layer buffers in order and, with MSAA, resolves into target.
+// target has to be in COLOR_ATTACHMENT_OPTIMAL layout.
+static void recordRendering(const VKUIX::Instance &instance, VkCommandBuffer cmdBuffer, VkBackend::RenderFrame &frame,
+                            VkImageView target, const VkRect2D &renderArea) {
+  // Every frame in flight shares the depth image, its previous contents are never needed. ATTACHMENT_OPTIMAL comes with
+  // synchronization2, DEPTH_ATTACHMENT_OPTIMAL would need separateDepthStencilLayouts.
+  VkImage depthImage = instance.depthImage.vkImage;
+  VkBackend::transitionImage(cmdBuffer, depthImage,
+                             VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                             VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+                             VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                             VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL, VK_IMAGE_ASPECT_DEPTH_BIT);
+
+  // The MSAA target is shared the same way and only ever resolved.
+  if (instance.msaaImage.vkImage) {
+    VkImage msaaImage = instance.msaaImage.vkImage;
+    VkBackend::transitionImage(cmdBuffer, msaaImage,
+                               VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+                               VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+                               VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL);
+  }
+
+  VkRenderingAttachmentInfo depthAttachment{VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO};
+  depthAttachment.imageView = instance.depthImage.view;
+  depthAttachment.imageLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL;
+  depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  depthAttachment.clearValue.depthStencil = {1.0f, 0};
 
   VkRenderingAttachmentInfo colorAttachment{VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO};
-  colorAttachment.imageView = instance->msaaImage.view;
   colorAttachment.imageLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL;
   colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-  colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
   colorAttachment.clearValue = {{0.1f, 0.1f, 0.1f, 1.0f}};
-  colorAttachment.resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT;
-  colorAttachment.resolveImageView = swapchainImageView;
-  colorAttachment.resolveImageLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL;
+  if (instance.msaaImage.vkImage) {
+    // Only the resolve is kept, the samples never leave tile memory on tilers.
+    colorAttachment.imageView = instance.msaaImage.view;
+    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    colorAttachment.resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT;
+    colorAttachment.resolveImageView = target;
+    colorAttachment.resolveImageLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL;
+  } else {
+    colorAttachment.imageView = target;
+    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  }
 
   VkRenderingInfo renderInfo{VK_STRUCTURE_TYPE_RENDERING_INFO};
-  renderInfo.renderArea = window->getRenderArea();
+  renderInfo.flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT;
+  renderInfo.renderArea = renderArea;
   renderInfo.layerCount = 1;
   renderInfo.colorAttachmentCount = 1;
   renderInfo.pColorAttachments = &colorAttachment;
+  renderInfo.pDepthAttachment = &depthAttachment;
 
-  VkCommandBufferBeginInfo cmdBegin{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
-  vkResetCommandBuffer(cmdBuffer, 0);
-  vkBeginCommandBuffer(cmdBuffer, &cmdBegin);
+  std::vector<VkCommandBuffer> layerBuffers{};
+  layerBuffers.reserve(frame.layerCount);
+  for (u32 i = 0; i < frame.layerCount; ++i) layerBuffers.push_back(frame.layers[i].buffer);
 
-  VkBackend::transitionImage(cmdBuffer, instance->backend.swapchain.images[swapchainImageIndex].vkImage,
-                             VK_PIPELINE_STAGE_2_NONE, 0,
-                             VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
-                             VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+  VkBackend::beginGpuZone(instance.backend, cmdBuffer, frame.queries, ZONE_RENDERING);
+  vkCmdBeginRendering(cmdBuffer, &renderInfo);
+  if (!layerBuffers.empty()) vkCmdExecuteCommands(cmdBuffer, layerBuffers.size(), layerBuffers.data());
+  vkCmdEndRendering(cmdBuffer);
+  VkBackend::endGpuZone(instance.backend, cmdBuffer, frame.queries);
+}
 
-  VkRect2D scissor = window->getRenderArea();
+// Starts the queries of a primary recording. The layer queries are reset as well, they are written again
+// whenever a layer buffer is executed, even if it was not re-recorded.
+static void beginFrameQueries(const VKUIX::Instance &instance, VkCommandBuffer cmdBuffer, VkBackend::RenderFrame &frame) {
+  VkBackend::resetQueryPool(cmdBuffer, frame.queries);
+  for (u32 i = 0; i < frame.layerCount; ++i)
+    VkBackend::resetQueryPool(cmdBuffer, frame.layers[i].queries);
+  VkBackend::clearQueryZones(frame.queries);
+  VkBackend::beginGpuZone(instance.backend, cmdBuffer, frame.queries, ZONE_FRAME);
+}
 
-  vkCmdSetViewport(cmdBuffer, 0, 1, &instance->viewport);
-  vkCmdSetScissor(cmdBuffer, 0, 1, &scissor);
+static void endFrameQueries(const VKUIX::Instance &instance, VkCommandBuffer cmdBuffer, VkBackend::RenderFrame &frame, const u64 pixels) {
+  VkBackend::endGpuZone(instance.backend, cmdBuffer, frame.queries);
+  frame.queriesPending = true;
+  frame.queryPixels = pixels;
+}
 
-  vkCmdBeginRendering(cmdBuffer, &renderInfo);
+// Reads the queries of the frame's last submission into the stats. Its fence has to have signaled, so this never waits.
+static void collectFrameQueries(VKUIX::Instance &instance, VkBackend::RenderFrame &frame) {
+  if (!frame.queriesPending) return;
+  frame.queriesPending = false;
+  VKUIX_PROFILE_ZONE("render.collectQueries");
 
-  vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, instance->defaultPipeline);
+  VKUIX::FrameStats &stats = instance.stats;
+  stats.gpuZones.clear();
+  stats.gpuStatistics = {};
+  if (!VkBackend::readQueries(instance.backend, frame.queries, stats.gpuZones, stats.gpuStatistics)) {
+    stats.gpuZones.clear();
+    return;
+  }
 
-  constexpr VkDeviceSize offset = 0;
+  // Layers execute one after another, their draw zones and statistics add up.
+  std::vector<VkBackend::GpuZoneTiming> contentZones{};
+  stats.gpuDrawMs = 0.0;
+  for (u32 i = 0; i < frame.layerCount; ++i) {
+    const size_t first = contentZones.size();
+    VkBackend::GpuStatistics layerStatistics{};
+    if (!VkBackend::readQueries(instance.backend, frame.layers[i].queries, contentZones, layerStatistics)) {
+      stats.gpuZones.clear();
+      return;
+    }
+    for (size_t z = first; z < contentZones.size(); ++z)
+      if (contentZones[z].name == ZONE_DRAWS) stats.gpuDrawMs += contentZones[z].ms;
+    stats.gpuStatistics.vertices += layerStatistics.vertices;
+    stats.gpuStatistics.vertexInvocations += layerStatistics.vertexInvocations;
+    stats.gpuStatistics.clippedPrimitives += layerStatistics.clippedPrimitives;
+    stats.gpuStatistics.fragmentInvocations += layerStatistics.fragmentInvocations;
+  }
 
-  vkCmdBindVertexBuffers(cmdBuffer, 0, 1, &vertexBuffer.buffer, &offset);
-  vkCmdPushConstants(cmdBuffer, instance->defaultPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(VkBackend::DefaultPushConstant), &pushConstant);
-  vkCmdDraw(cmdBuffer, instance->renderList->getVertices().size(), 1, 0, 0);
+  stats.gpuFrameMs = 0.0;
+  double renderingMs = 0.0;
 
-  vkCmdEndRendering(cmdBuffer);
+  // The layer zones run inside the rendering zone, nest them below it.
+  for (u32 i = 0; i < stats.gpuZones.size(); ++i) {
+    const VkBackend::GpuZoneTiming zone = stats.gpuZones[i];
+    if (zone.name == ZONE_FRAME) stats.gpuFrameMs = zone.ms;
+    if (zone.name != ZONE_RENDERING) continue;
 
-  VkBackend::transitionImage(cmdBuffer, instance->backend.swapchain.images[swapchainImageIndex].vkImage,
-                             VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
-                             VK_PIPELINE_STAGE_2_NONE, 0,
-                             VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+    renderingMs = zone.ms;
+    for (VkBackend::GpuZoneTiming &content : contentZones) content.depth += zone.depth + 1;
+    stats.gpuZones.insert(stats.gpuZones.begin() + i + 1, contentZones.begin(), contentZones.end());
+    i += contentZones.size();
+  }
+  stats.gpuAttachmentMs = glm::max(renderingMs - stats.gpuDrawMs, 0.0);
+  stats.overdraw = frame.queryPixels ? static_cast<double>(stats.gpuStatistics.fragmentInvocations) / static_cast<double>(frame.queryPixels) : 0.0;
+}
 
-  vkEndCommandBuffer(cmdBuffer);
+// Ends a frame that presents nothing.
+static void skipFrame(VKUIX::Instance &instance) {
+  instance.stats.skippedFrames++;
+  instance.stats.damage = {};
+  instance.stats.damagedPixels = 0;
+  instance.stats.uploadBytes = 0;
+  clearRenderLists(instance);
+  instance.latencyWaited = false;
+}
+
+void VKUIX::render(const sptr<Instance> &instance, const sptr<Window>& window) {
+  VKUIX_PROFILE_ZONE("render");
+  waitForFrameLatency(instance);
+
+  // A minimized window has nothing to present into. skipFrame still counts the RenderLists as drawn,
+  // so restoring the window recreates the swapchain and redraws everything, even at the same size.
+  const VkExtent2D windowExtent = window->getExtent();
+  if (windowExtent.width == 0 || windowExtent.height == 0) {
+    instance->swapchainOutdated = true;
+    skipFrame(*instance);
+    return;
+  }
+  const VkExtent2D createdFor = instance->swapchainWindowExtent;
+  if (instance->swapchainOutdated || windowExtent.width != createdFor.width || windowExtent.height != createdFor.height)
+    recreateSwapchain(*instance, window);
+
+  VkBackend::RenderFrame &frame = instance->renderFrames[instance->frameIndex];
+  const VkRect2D fullArea{{0, 0}, instance->backend.swapchain.extent};
+  FrameStats &stats = instance->stats;
+
+  {
+    VKUIX_PROFILE_ZONE("render.waitFence");
+    vkWaitForFences(instance->backend.device, 1, &frame.renderFence, VK_TRUE, UINT64_MAX);
+  }
+  collectFrameQueries(*instance, frame);
+  releaseCompleted(*instance);
+  if (resolvePipelines(*instance)) redrawAll(*instance);
+
+  // What changed on screen since the last frame. Nothing changed, nothing to present.
+  const VkRect2D frameDamage = instance->damageTracking ? intersectRect(renderListsDamage(*instance), fullArea) : fullArea;
+  if (emptyRect(frameDamage)) {
+    skipFrame(*instance);
+    return;
+  }
+  for (VkRect2D &damage : instance->imageDamage)
+    damage = unionRect(damage, frameDamage);
+
+  u32 swapchainImageIndex;
+  VkResult acquired;
+  {
+    VKUIX_PROFILE_ZONE("render.acquire");
+    acquired = vkAcquireNextImageKHR(instance->backend.device, instance->backend.swapchain.swapchain, UINT64_MAX, frame.acquireSema, nullptr, &swapchainImageIndex);
+  }
+  // Nothing was acquired and the semaphore stays unsignaled. The next frame recreates the swapchain and redraws everything.
+  if (acquired == VK_ERROR_OUT_OF_DATE_KHR) {
+    instance->swapchainOutdated = true;
+    skipFrame(*instance);
+    return;
+  }
+  // Suboptimal still presents, the swapchain is replaced before the next frame.
+  if (acquired == VK_SUBOPTIMAL_KHR) instance->swapchainOutdated = true;
+
+  // The acquired image still holds what was drawn into it last time, only the damage since then is redrawn.
+  const VkRect2D renderArea = instance->imageDamage[swapchainImageIndex];
+  const bool fullRedraw = sameRect(renderArea, fullArea);
+  instance->imageDamage[swapchainImageIndex] = {};
+  stats.damage = renderArea;
+  stats.damagedPixels = static_cast<u64>(renderArea.extent.width) * renderArea.extent.height;
+
+  prepareContent(*instance, frame, renderArea);
+
+  vkResetFences(instance->backend.device, 1, &frame.renderFence);
+
+  Image &swapchainImage = instance->backend.swapchain.images[swapchainImageIndex];
+  VkCommandBuffer cmdBuffer = frame.commandBuffer;
+
+  {
+    VKUIX_PROFILE_ZONE("render.recordPrimary");
+
+    // The primary buffer only holds the swapchain dependent part of the frame and is re-recorded every time.
+    VkCommandBufferBeginInfo cmdBegin{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+    cmdBegin.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkResetCommandBuffer(cmdBuffer, 0);
+    vkBeginCommandBuffer(cmdBuffer, &cmdBegin);
+    beginFrameQueries(*instance, cmdBuffer, frame);
+
+    // Load and store ops and the resolve only touch the render area, the rest of the image is kept unless it is redrawn anyway.
+    VkBackend::beginGpuZone(instance->backend, cmdBuffer, frame.queries, "transition.attachment");
+    // Its source stage is the one the acquire semaphore is waited on, so the layout change happens after the image is released.
+    VkBackend::transitionImage(cmdBuffer, swapchainImage.vkImage,
+                               VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, 0,
+                               VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+                               fullRedraw ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+    VkBackend::endGpuZone(instance->backend, cmdBuffer, frame.queries);
+
+    recordAtlasUpload(*instance, cmdBuffer, frame);
+    recordRendering(*instance, cmdBuffer, frame, swapchainImage.view, renderArea);
+
+    VkBackend::beginGpuZone(instance->backend, cmdBuffer, frame.queries, "transition.present");
+    VkBackend::transitionImage(cmdBuffer, swapchainImage.vkImage,
+                               VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+                               VK_PIPELINE_STAGE_2_NONE, 0,
+                               VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+    VkBackend::endGpuZone(instance->backend, cmdBuffer, frame.queries);
+
+    endFrameQueries(*instance, cmdBuffer, frame, stats.damagedPixels);
+    vkEndCommandBuffer(cmdBuffer);
+  }
 
-  std::vector commandBuffers = {cmdBuffer};
-  const std::vector<VkPipelineStageFlags> dstMasks = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+  FrameWaits waits{};
+  waits.semaphores = {frame.acquireSema};
+  waits.stages = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+  waits.values = {0};
 
   VkSubmitInfo submitInfo{VK_STRUCTURE_TYPE_SUBMIT_INFO};
-  submitInfo.commandBufferCount = commandBuffers.size();
-  submitInfo.pCommandBuffers = commandBuffers.data();
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &cmdBuffer;
 
-  submitInfo.pWaitSemaphores = &presentSema;
+  // Signaled per image: with more images than frame slots, the slot's previous image may not have been presented yet.
+  const VkSemaphore renderSema = instance->backend.swapchain.renderSemas[swapchainImageIndex];
   submitInfo.pSignalSemaphores = &renderSema;
-  submitInfo.waitSemaphoreCount = 1;
   submitInfo.signalSemaphoreCount = 1;
-  submitInfo.pWaitDstStageMask = dstMasks.data();
+  waitForUploads(*instance, waits, submitInfo);
 
-  if (vkQueueSubmit(instance->backend.graphicsQueue, 1, &submitInfo, renderFence) != VK_SUCCESS)
-    LOG(W, "Could not submit queue.");
+  {
+    VKUIX_PROFILE_ZONE("render.submit");
+    if (vkQueueSubmit(instance->backend.graphicsQueue, 1, &submitInfo, frame.renderFence) != VK_SUCCESS)
+      LOG(W, "Could not submit queue.");
+    instance->submittedFrames++;
+  }
+  frame.submitTime = std::chrono::steady_clock::now();
+  frame.presentId = ++instance->backend.swapchain.presentId;
+  frame.presentObserved = false;
+  stats.inputToSubmitMs = std::chrono::duration<double, std::milli>(frame.submitTime - instance->inputTime).count();
+  instance->latencyWaited = false;
 
   VkPresentInfoKHR presentInfo{VK_STRUCTURE_TYPE_PRESENT_INFO_KHR};
   presentInfo.swapchainCount = 1;
@@ -168,9 +1224,128 @@ void VKUIX::render(const sptr<Instance> &instance, const sptr<Window>& window) {
   presentInfo.waitSemaphoreCount = 1;
   presentInfo.pWaitSemaphores = &renderSema;
 
-  vkQueuePresentKHR(instance->backend.graphicsQueue, &presentInfo);
-  instance->frameIndex = (instance->frameIndex + 1) % instance->backend.swapchain.framebufferingAmount; // Advance frame index.
+  // Tell the compositor which part of the screen changed since the last present.
+  VkRectLayerKHR presentRect{frameDamage.offset, frameDamage.extent, 0};
+  VkPresentRegionKHR presentRegion{1, &presentRect};
+  VkPresentRegionsKHR presentRegions{VK_STRUCTURE_TYPE_PRESENT_REGIONS_KHR};
+  presentRegions.swapchainCount = 1;
+  presentRegions.pRegions = &presentRegion;
+  if (instance->incrementalPresent && !sameRect(frameDamage, fullArea))
+    presentInfo.pNext = &presentRegions;
+
+  // Lets waitForFrameLatency wait for this present.
+  VkPresentIdKHR presentId{VK_STRUCTURE_TYPE_PRESENT_ID_KHR};
+  presentId.swapchainCount = 1;
+  presentId.pPresentIds = &frame.presentId;
+  if (instance->backend.waitForPresent) {
+    presentId.pNext = presentInfo.pNext;
+    presentInfo.pNext = &presentId;
+  }
+
+  {
+    VKUIX_PROFILE_ZONE("render.present");
+    const VkResult presented = vkQueuePresentKHR(instance->backend.graphicsQueue, &presentInfo);
+    if (presented == VK_ERROR_OUT_OF_DATE_KHR || presented == VK_SUBOPTIMAL_KHR) instance->swapchainOutdated = true;
+  }
+  instance->frameIndex = (instance->frameIndex + 1) % instance->renderFrames.size(); // Advance frame index.
+
+  // Pipelines created after startup are saved as well, in case the process is killed before destroyInstance.
+  if (std::chrono::steady_clock::now() - instance->pipelineCacheSaveTime > PIPELINE_CACHE_SAVE_INTERVAL) {
+    VkBackend::savePipelineCache(instance->backend);
+    instance->pipelineCacheSaveTime = std::chrono::steady_clock::now();
+  }
+
+  VKUIX_PROFILE_ZONE("render.clear");
+  clearRenderLists(*instance);
 
-  instance->renderList->clear();
+}
+
+void VKUIX::renderOffscreen(const sptr<Instance> &instance, std::vector<u8> &pixelsOut) {
+  VKUIX_PROFILE_ZONE("renderOffscreen");
+  if (!instance->headless) {
+    LOG(W, "renderOffscreen needs an instance from createHeadlessInstance.");
+    return;
+  }
+
+  VkBackend::RenderFrame &frame = instance->renderFrames[instance->frameIndex];
+  Image &target = instance->offscreenTarget;
+  const VkRect2D renderArea{{0, 0}, target.extent};
+
+  vkWaitForFences(instance->backend.device, 1, &frame.renderFence, VK_TRUE, UINT64_MAX);
+  releaseCompleted(*instance);
+  resolvePipelines(*instance); // Fully redrawn anyway
+  prepareContent(*instance, frame, renderArea);
+  vkResetFences(instance->backend.device, 1, &frame.renderFence);
+
+  instance->stats.damage = renderArea;
+  instance->stats.damagedPixels = static_cast<u64>(renderArea.extent.width) * renderArea.extent.height;
+
+  VkCommandBuffer cmdBuffer = frame.commandBuffer;
+  VkCommandBufferBeginInfo cmdBegin{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+  cmdBegin.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  vkResetCommandBuffer(cmdBuffer, 0);
+  vkBeginCommandBuffer(cmdBuffer, &cmdBegin);
+  beginFrameQueries(*instance, cmdBuffer, frame);
+
+  // Fully redrawn every time, the previous contents have already been read back.
+  VkBackend::beginGpuZone(instance->backend, cmdBuffer, frame.queries, "transition.attachment");
+  VkBackend::transitionImage(cmdBuffer, target.vkImage,
+                             VK_PIPELINE_STAGE_2_COPY_BIT, 0,
+                             VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+                             VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+  VkBackend::endGpuZone(instance->backend, cmdBuffer, frame.queries);
+
+  recordAtlasUpload(*instance, cmdBuffer, frame);
+  recordRendering(*instance, cmdBuffer, frame, target.view, renderArea);
+
+  VkBackend::beginGpuZone(instance->backend, cmdBuffer, frame.queries, "transition.transferSrc");
+  VkBackend::transitionImage(cmdBuffer, target.vkImage,
+                             VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+                             VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_READ_BIT,
+                             VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+  VkBackend::endGpuZone(instance->backend, cmdBuffer, frame.queries);
+
+  VkBufferImageCopy region{};
+  region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  region.imageSubresource.layerCount = 1;
+  region.imageExtent = {target.extent.width, target.extent.height, 1};
+  VkBackend::beginGpuZone(instance->backend, cmdBuffer, frame.queries, "copy.readback");
+  vkCmdCopyImageToBuffer(cmdBuffer, target.vkImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, instance->readback.buffer.buffer, 1, &region);
+  VkBackend::endGpuZone(instance->backend, cmdBuffer, frame.queries);
+  endFrameQueries(*instance, cmdBuffer, frame, instance->stats.damagedPixels);
+
+  // Make the copy visible to the host once the fence signals.
+  VkMemoryBarrier2 hostBarrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER_2};
+  hostBarrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+  hostBarrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+  hostBarrier.dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT;
+  hostBarrier.dstAccessMask = VK_ACCESS_2_HOST_READ_BIT;
+
+  VkDependencyInfo depInfo{VK_STRUCTURE_TYPE_DEPENDENCY_INFO};
+  depInfo.memoryBarrierCount = 1;
+  depInfo.pMemoryBarriers = &hostBarrier;
+  vkCmdPipelineBarrier2(cmdBuffer, &depInfo);
+
+  vkEndCommandBuffer(cmdBuffer);
+
+  VkSubmitInfo submitInfo{VK_STRUCTURE_TYPE_SUBMIT_INFO};
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &cmdBuffer;
+  FrameWaits waits{};
+  waitForUploads(*instance, waits, submitInfo);
+
+  if (vkQueueSubmit(instance->backend.graphicsQueue, 1, &submitInfo, frame.renderFence) != VK_SUCCESS)
+    LOG(W, "Could not submit queue.");
+  instance->submittedFrames++;
+
+  {
+    VKUIX_PROFILE_ZONE("renderOffscreen.waitReadback");
+    vkWaitForFences(instance->backend.device, 1, &frame.renderFence, VK_TRUE, UINT64_MAX);
+  }
+  collectFrameQueries(*instance, frame); // Already waited for, so the results are current
+  Buffers::invalidateReadback(instance->backend.allocator, instance->readback);
+  pixelsOut.assign(instance->readback.mapped, instance->readback.mapped + instance->readback.size);
 
+  instance->frameIndex = (instance->frameIndex + 1) % instance->renderFrames.size();
+  clearRenderLists(*instance);
 }
@@ -1,38 +1,236 @@
 #pragma once
 
+#include <array>
+#include <chrono>
+
 #include <glm/gtc/constants.hpp>
 
+#include "batcher.h"
+#include "buffer.h"
+#include "glyph_atlas.h"
 #include "renderlist.h"
+#include "taskpool.h"
+#include "textures.h"
+#include "upload_manager.h"
 
 namespace VKUIX {
 
+  // Frame slots the CPU may record ahead of the GPU. Each slot owns its command buffers, fence, query pool
+  // and upload ring slices, so more slots trade memory and latency for fewer stalls on the fence.
+  inline constexpr u32 DEFAULT_FRAMES_IN_FLIGHT = 2;
+  inline constexpr u32 MAX_FRAMES_IN_FLIGHT = 4;
+
+  // How edges are smoothed, see setAntiAliasing. Analytic computes a coverage in the shaders of shapes that have a distance
+  // to their edge, currently RoundRect. MSAA smooths the edges of every geometry and keeps the analytic coverage, the
+  // fragment shader runs once per pixel and would otherwise step at the pixel centers of curved edges.
+  enum class AntiAliasing : u8 {
+    Off = 0,
+    Analytic = 1,
+    Msaa2 = 2,
+    Msaa4 = 3,
+    Msaa8 = 4,
+  };
+
+  struct FrameStats {
+    VkDeviceSize uploadBytes{0}; // Bytes written into the upload ring last frame.
+    VkDeviceSize uploadCapacity{0}; // Bytes available per frame slice.
+    VkDeviceSize uploadHighWaterMark{0};
+    u32 uploadGrowCount{0};
+
+    u32 drawCommands{0}; // Commands recorded by the RenderList
+    u32 drawCalls{0}; // Draws issued after sorting and merging, opaque RoundRect draws count twice
+    u32 mergedDraws{0}; // Commands folded into a previous draw
+    u32 opaqueDraws{0}; // Draws in the front to back opaque pass
+    u32 culledPrimitives{0}; // Primitives rejected by RenderList clipping
+
+    // Frames whose RenderList hash matched, reusing the uploaded data and the recorded layer buffers.
+    u64 cacheHits{0};
+    u64 cacheMisses{0};
+    double cacheMissCostMs{0.0}; // Running average of upload + record time on a miss
+    double cacheTimeSavedMs{0.0}; // cacheMissCostMs credited for every hit
+    u32 recordedLayers{0}; // Layer buffers recorded last frame
+    u32 reusedLayers{0}; // Layer buffers executed as they were recorded in an earlier frame
+
+    // Damage tracking
+    u64 skippedFrames{0}; // Frames without damage, minimized or with an out of date swapchain, not presented
+    VkRect2D damage{}; // Area redrawn last frame
+    u64 damagedPixels{0};
+
+    // GPU side, from the last submission of the current frame slot. Read once its fence has signaled,
+    // so these lag behind by the number of frames in flight. Empty without timestamp support.
+    std::vector<VkBackend::GpuZoneTiming> gpuZones{}; // Nested in begin order
+    double gpuFrameMs{0.0};
+    double gpuDrawMs{0.0}; // All draw batches
+    double gpuAttachmentMs{0.0}; // Rendering minus the draws: clear, MSAA resolve and store
+    VkBackend::GpuStatistics gpuStatistics{};
+    double overdraw{0.0}; // Fragment shader invocations per rendered pixel
+
+    GlyphAtlas::Stats glyphs{}; // Totals since the instance was created
+    u32 glyphUploadRects{0}; // Atlas rects uploaded last frame
+    u32 textures{0}; // Textures in the texture table, the glyph atlas included
+    UploadManager::Stats transfers{}; // Totals of the upload manager since the instance was created
+
+    // Latency. inputToSubmitMs runs from waitForFrameLatency to the submission of the frame. submitToPresentMs is that of
+    // the last submission seen presented, or seen completed on the GPU without VK_KHR_present_wait (presentWaitTiming false).
+    // Submissions are checked on the render thread, one found done without waiting counts until it was checked.
+    double inputToSubmitMs{0.0};
+    double submitToPresentMs{0.0};
+    bool presentWaitTiming{false};
+
+    [[nodiscard]] double cacheHitRate() const {
+      const u64 total = cacheHits + cacheMisses;
+      return total ? static_cast<double>(cacheHits) / static_cast<double>(total) : 0.0;
+    }
+  };
+
   struct Instance {
     VkBackend::Instance backend;
 
     VkCommandPool cmdPool{};
-    VkCommandPool uploadPool{};
+    VkCommandPool uploadPool{}; // Transfer queue family, used by uploads
     VkCommandBuffer cmdBuffer{};
 
     VkDescriptorPool mainDescPool{};
     VkDescriptorSetLayout descLayoutUniform{};
     VkDescriptorSet mainDescriptor{};
 
-    VkPipeline defaultPipeline{};
-    VkPipelineLayout defaultPipelineLayout{};
+    // Every texture the Textured pipeline samples, descriptor set 1. Destroyed textures are released
+    // once submittedFrames shows that the frames in flight when they were destroyed have completed.
+    TextureTable textures{};
+    VkSampler textureSampler{};
+    u64 submittedFrames{0};
+
+    // Static content into device local memory. Every frame submission waits for all uploads flushed before it.
+    UploadManager uploads{};
+
+    // Glyph atlas of RenderList::text, in the texture table like any other texture.
+    uptr<GlyphAtlas> glyphAtlas{};
+    Image glyphAtlasImage{}; // Owned by the texture table
+    TextureId glyphTexture{INVALID_TEXTURE};
+    Buffers::RingBuffer glyphStaging{}; // One slice per frame, large enough for the whole atlas
+
+    // Variant drawn for each PipelineId. Resolved through backend.pipelineRepository whenever content is recorded,
+    // pipelines holds a compatible fallback until a changed variant has compiled in the background.
+    // The descs are the translucent pass variants, opaquePipelines the opaque pass ones derived from them.
+    std::array<VkBackend::PipelineDesc, PIPELINE_ID_COUNT> pipelineDescs{};
+    std::array<VkPipeline, PIPELINE_ID_COUNT> pipelines{};
+    std::array<VkPipeline, PIPELINE_ID_COUNT> opaquePipelines{}; // Null for Textured, which is never opaque
 
     VkViewport viewport{};
-    Image msaaImage{};
+    AntiAliasing antiAliasing{AntiAliasing::Analytic};
+    VkSampleCountFlagBits samples{VK_SAMPLE_COUNT_1_BIT}; // Of the pipelines, the color target and depthImage
+    Image msaaImage{}; // Transient, only allocated with more than one sample
+    Image depthImage{}; // Transient, DEPTH_FORMAT with samples samples
 
+    // Swapchain recreation. Replaced objects wait in retired, in retirement order, for the frames that used them.
+    bool swapchainOutdated{false}; // Acquire or present reported the swapchain out of date or suboptimal
+    VkExtent2D swapchainWindowExtent{}; // Window extent the swapchain was created for, the surface may have picked another
+    std::vector<VkBackend::Retired> retired{};
+
+    // One per frame in flight, independent of the swapchain image count.
     std::vector<VkBackend::RenderFrame> renderFrames{};
     u32 frameIndex{0};
+    // Frame latency limiter, see setMaxQueuedFrames. inputTime is when the current frame passed waitForFrameLatency.
+    u32 maxQueuedFrames{0};
+    bool latencyWaited{false};
+    std::chrono::steady_clock::time_point inputTime{};
+    uptr<TaskPool> workers{}; // Records the layer buffers of a frame in parallel
+    std::chrono::steady_clock::time_point pipelineCacheSaveTime{};
+
+    // Only redraw what changed. imageDamage holds, per swapchain image, everything that changed since it was last drawn.
+    bool damageTracking{true};
+    bool incrementalPresent{false}; // VK_KHR_incremental_present is enabled
+    std::vector<VkRect2D> imageDamage{};
+
+    Buffers::RingBuffer uploadRing{};
+    DrawBatcher batcher{};
+    FrameStats stats{};
 
     uptr<RenderList> renderList{};
+    // Filled from other threads, drawn together with renderList. renderLists is renderList followed by the shards.
+    std::vector<uptr<RenderList>> renderListShards{};
+    std::vector<RenderList*> renderLists{};
+
+    // Headless instances render into offscreenTarget instead of a swapchain and copy it into readback.
+    bool headless{false};
+    Image offscreenTarget{};
+    Buffers::ReadbackBuffer readback{};
   };
 
   sptr<Window> createWindow(const char *title, Dim dimension);
-  sptr<Instance> createInstance(const sptr<Window> &window, const std::vector<const char *> *additionalExtensions = nullptr);
+  // framesInFlight is clamped to [1, MAX_FRAMES_IN_FLIGHT].
+  sptr<Instance> createInstance(const sptr<Window> &window, const std::vector<const char *> *additionalExtensions = nullptr,
+                                u32 framesInFlight = DEFAULT_FRAMES_IN_FLIGHT);
+  // Renders without a window or surface into an offscreen image of the given extent, read back with renderOffscreen.
+  sptr<Instance> createHeadlessInstance(VkExtent2D extent);
+  void destroyInstance(const sptr<Instance> &instance);
 
   uptr<RenderList> &getRenderList(const sptr<Instance> &instance);
+  // Sets the number of RenderList shards. Call from the render thread while no shard is being filled.
+  void setRenderListShardCount(const sptr<Instance> &instance, u32 count);
+  // Shards have their own geometry, commands and clip stack, so each can be filled by its own thread in parallel.
+  // They are merged into the upload ring at render time without an intermediate copy. Draw order across lists
+  // is decided by layer, within a layer the main RenderList goes first, then the shards by index.
+  // render() clears them together with the main RenderList, so all filling has to be done by then.
+  uptr<RenderList> &getRenderListShard(const sptr<Instance> &instance, u32 shard);
+  // Recreates the swapchain first if the window was resized or the last frame found it out of date.
+  // Skips the frame while the window is minimized.
   void render(const sptr<Instance> &instance, const sptr<Window> &window);
+  // Renders the RenderList of a headless instance and waits for the result. pixelsOut receives
+  // width * height tightly packed texels in VkBackend::COLOR_FORMAT, rows top to bottom.
+  void renderOffscreen(const sptr<Instance> &instance, std::vector<u8> &pixelsOut);
+
+  // Loads a TrueType font for RenderList::text. Returns INVALID_FONT if the file could not be loaded.
+  // Call from the render thread while no RenderList is being filled.
+  FontId loadFont(const sptr<Instance> &instance, const std::string &path);
+
+  // Creates a texture for RenderList::image from width * height RGBA8 texels, rows top to bottom.
+  // The upload is queued and submitted by the next render() at the latest, frames drawing the texture wait for it
+  // on the GPU. ticketOut can be checked with uploadComplete. Returns INVALID_TEXTURE if the texture table is full.
+  // Call from the render thread.
+  TextureId createTexture(const sptr<Instance> &instance, u32 width, u32 height, const u8 *rgba, UploadTicket *ticketOut = nullptr);
+  // Frames still in flight may draw the texture, its memory and slot are reused once they have completed.
+  // Nothing recorded afterwards may draw it. Call from the render thread.
+  void destroyTexture(const sptr<Instance> &instance, TextureId texture);
+
+  // Device local buffer for static content, e.g. retained meshes, filled with uploadBuffer. Free it with
+  // Buffers::freeBuffer once no frame in flight uses it anymore.
+  Buffers::Buffer createDeviceBuffer(const sptr<Instance> &instance, VkDeviceSize size, VkBufferUsageFlags usage);
+  // Queues a copy of size bytes into dst at dstOffset, data can be freed right away. Frames rendered afterwards
+  // wait for it on the GPU. Call from the render thread.
+  UploadTicket uploadBuffer(const sptr<Instance> &instance, const void *data, VkDeviceSize size, VkBuffer dst, VkDeviceSize dstOffset = 0);
+  // Whether an upload has landed in device memory.
+  bool uploadComplete(const sptr<Instance> &instance, UploadTicket ticket);
+  // Submits the upload if it is still queued and blocks until it has landed.
+  void waitUpload(const sptr<Instance> &instance, UploadTicket ticket);
+
+  // Draws everything of the given PipelineId with another variant. A variant that was not used before is compiled
+  // in the background, until then a compatible one stands in. Only a different sample count has to wait for it.
+  // The vertex format has to stay the one the RenderList emits for that PipelineId. The sample count of desc is
+  // replaced with that of the antialiasing mode, see setAntiAliasing. The whole window is redrawn, again once the
+  // variant replaces its stand in. Call it between frames, like setAntiAliasing.
+  void setPipelineVariant(const sptr<Instance> &instance, PipelineId pipeline, const VkBackend::PipelineDesc &desc);
+
+  // Switches antialiasing without waiting for the frames in flight. MSAA counts the device does not support fall back to
+  // the closest lower one. Call from the render thread while no RenderList is being filled.
+  void setAntiAliasing(const sptr<Instance> &instance, AntiAliasing mode);
+  // The sample count in use, which may be lower than the mode asks for.
+  VkSampleCountFlagBits getSampleCount(const sptr<Instance> &instance);
+
+  // Recreates the swapchain with another present mode, or the closest one the surface supports, see VkBackend::setupSwapchain.
+  // Like a resize, this does not wait for the frames in flight.
+  // MAILBOX and IMMEDIATE do not wait for vertical blank, so a frame is not held back behind a queue of earlier ones.
+  // Call from the render thread.
+  void setPresentMode(const sptr<Instance> &instance, const sptr<Window> &window, VkPresentModeKHR mode);
+  // The mode in use, which may be a fallback of the requested one.
+  VkPresentModeKHR getPresentMode(const sptr<Instance> &instance);
+  // Caps the frames submitted but not yet presented, 0 disables the limiter. More than the frames in flight
+  // are never queued anyway. Lower values trade throughput for input latency.
+  void setMaxQueuedFrames(const sptr<Instance> &instance, u32 frames);
+  // Blocks until another frame may be queued. Call right before polling input, so the frame reacts to the newest input.
+  // render() calls it for frames that did not. Waits for presentation with VK_KHR_present_wait, for the GPU otherwise.
+  void waitForFrameLatency(const sptr<Instance> &instance);
+
+  const FrameStats &getFrameStats(const sptr<Instance> &instance);
 
 } // namespace VKUIX
\ No newline at end of file
@@ -1,10 +1,17 @@
 #define VMA_IMPLEMENTATION
 #include "vulkan_backend.h"
+#include "profiler.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <ranges>
 #include <set>
 
 void VkBackend::setupInstance(Instance &instance, const std::vector<const char *>& extensions) {
+  VKUIX_PROFILE_ZONE("VkBackend::setupInstance");
   LOG(D, "Creating VkInstance.");
   // Application info and api version of Vulkan
   VkApplicationInfo appInfo{VK_STRUCTURE_TYPE_APPLICATION_INFO};
@@ -33,10 +40,17 @@ void VkBackend::setupInstance(Instance &instance, const std::vector<const char *
   if (vkCreateInstance(&instanceCreateInfo, nullptr, &instance.vkInstance) != VK_SUCCESS) {
     LOG(F, "Could not create VkInstance.");
   }
+
+  for (const char *ext : extensions) {
+    if (strcmp(ext, VK_EXT_DEBUG_UTILS_EXTENSION_NAME) != 0) continue;
+    instance.cmdBeginDebugLabel = reinterpret_cast<PFN_vkCmdBeginDebugUtilsLabelEXT>(vkGetInstanceProcAddr(instance.vkInstance, "vkCmdBeginDebugUtilsLabelEXT"));
+    instance.cmdEndDebugLabel = reinterpret_cast<PFN_vkCmdEndDebugUtilsLabelEXT>(vkGetInstanceProcAddr(instance.vkInstance, "vkCmdEndDebugUtilsLabelEXT"));
+  }
   LOG(S, "Created VkInstance.");
 }
 
 void VkBackend::setupSurface(Instance &instance, GLFWwindow *pWin) {
+  VKUIX_PROFILE_ZONE("VkBackend::setupSurface");
   // Get window render surface
   if (glfwCreateWindowSurface(instance.vkInstance, pWin, nullptr, &instance.surface) != VK_SUCCESS) {
     LOG(F, "Could not create window surface using glfw.");
@@ -45,6 +59,7 @@ void VkBackend::setupSurface(Instance &instance, GLFWwindow *pWin) {
 }
 
 void VkBackend::setupDevices(Instance &instance) {
+  VKUIX_PROFILE_ZONE("VkBackend::setupDevices");
   // Choose gpu
   u32 deviceCount = 0;
   vkEnumeratePhysicalDevices(instance.vkInstance, &deviceCount, nullptr);
@@ -58,7 +73,8 @@ void VkBackend::setupDevices(Instance &instance) {
 
   // Device Queues
   std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-  const std::set uQueueFamilies = {instance.queueFamilies.graphicsFamily.value(), instance.queueFamilies.presentFamily.value()};
+  const std::set uQueueFamilies = {instance.queueFamilies.graphicsFamily.value(), instance.queueFamilies.presentFamily.value(),
+                                   instance.queueFamilies.transferFamily.value()};
   constexpr float queuePrio = 1;
   for (const u32 queueFamily: uQueueFamilies) {
     VkDeviceQueueCreateInfo queueCreateInfo{VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO};
@@ -76,20 +92,111 @@ void VkBackend::setupDevices(Instance &instance) {
   sync2Feat.synchronization2 = VK_TRUE;
   sync2Feat.pNext = &dynamicRenderingFeat;
 
+  // Bindless texture table, see VKUIX::TextureTable. Vulkan 1.3 guarantees this subset of descriptor indexing.
+  VkPhysicalDeviceDescriptorIndexingFeatures supportedIndexing{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES};
+  VkPhysicalDevicePresentIdFeaturesKHR supportedPresentId{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR};
+  VkPhysicalDevicePresentWaitFeaturesKHR supportedPresentWait{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR};
+  VkPhysicalDeviceFeatures2 supportedFeatures2{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2};
+  supportedFeatures2.pNext = &supportedIndexing;
+  supportedIndexing.pNext = &supportedPresentId;
+  supportedPresentId.pNext = &supportedPresentWait;
+  vkGetPhysicalDeviceFeatures2(instance.physDevice, &supportedFeatures2);
+  if (!supportedIndexing.runtimeDescriptorArray || !supportedIndexing.descriptorBindingPartiallyBound ||
+      !supportedIndexing.descriptorBindingSampledImageUpdateAfterBind || !supportedIndexing.descriptorBindingUpdateUnusedWhilePending ||
+      !supportedIndexing.shaderSampledImageArrayNonUniformIndexing)
+    LOG(F, "The physical device does not support descriptor indexing for sampled images.");
+
+  VkPhysicalDeviceDescriptorIndexingFeatures indexingFeat{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES};
+  indexingFeat.runtimeDescriptorArray = VK_TRUE;
+  indexingFeat.descriptorBindingPartiallyBound = VK_TRUE;
+  indexingFeat.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+  indexingFeat.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+  indexingFeat.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+  indexingFeat.pNext = &sync2Feat;
+
+  // Completion of uploads, see VKUIX::UploadManager. Required since Vulkan 1.2.
+  VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeat{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES};
+  timelineFeat.timelineSemaphore = VK_TRUE;
+  timelineFeat.pNext = &indexingFeat;
+
+  // Pipeline statistics are only used for profiling, enabled where available.
+  VkPhysicalDeviceFeatures supportedFeatures{};
+  vkGetPhysicalDeviceFeatures(instance.physDevice, &supportedFeatures);
+  VkPhysicalDeviceFeatures enabledFeatures{};
+  enabledFeatures.pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery;
+
+  // Device Extensions
+  u32 extCount = 0;
+  vkEnumerateDeviceExtensionProperties(instance.physDevice, nullptr, &extCount, nullptr);
+  std::vector<VkExtensionProperties> availableExt(extCount);
+  vkEnumerateDeviceExtensionProperties(instance.physDevice, nullptr, &extCount, availableExt.data());
+
+  const auto extensionAvailable = [&availableExt](const char *name) {
+    return std::any_of(availableExt.begin(), availableExt.end(), [name](const VkExtensionProperties &ext) {
+      return strcmp(ext.extensionName, name) == 0;
+    });
+  };
+
+  // Frame pacing, see VKUIX::waitForFrameLatency. Chained in front of the required features when enabled.
+  VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeat{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR};
+  presentWaitFeat.presentWait = VK_TRUE;
+  presentWaitFeat.pNext = &timelineFeat;
+  VkPhysicalDevicePresentIdFeaturesKHR presentIdFeat{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR};
+  presentIdFeat.presentId = VK_TRUE;
+  presentIdFeat.pNext = &presentWaitFeat;
+  bool presentWait = false;
+
+  instance.deviceExtensions = DEVICE_EXT;
+  if (instance.surface) {
+    instance.deviceExtensions.insert(instance.deviceExtensions.end(), PRESENT_DEVICE_EXT.begin(), PRESENT_DEVICE_EXT.end());
+
+    for (const char *optionalExt : OPTIONAL_PRESENT_DEVICE_EXT) {
+      if (extensionAvailable(optionalExt)) {
+        instance.deviceExtensions.push_back(optionalExt);
+        LOG(D, std::string("Enabled optional device extension ") + optionalExt);
+      }
+    }
+
+    presentWait = supportedPresentId.presentId && supportedPresentWait.presentWait &&
+                  std::all_of(PRESENT_WAIT_DEVICE_EXT.begin(), PRESENT_WAIT_DEVICE_EXT.end(), extensionAvailable);
+    if (presentWait)
+      instance.deviceExtensions.insert(instance.deviceExtensions.end(), PRESENT_WAIT_DEVICE_EXT.begin(), PRESENT_WAIT_DEVICE_EXT.end());
+  }
+
   // Logical Device
   VkDeviceCreateInfo deviceInfo{VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO};
-  deviceInfo.enabledExtensionCount = DEVICE_EXT.size();
-  deviceInfo.ppEnabledExtensionNames = DEVICE_EXT.data();
+  deviceInfo.enabledExtensionCount = instance.deviceExtensions.size();
+  deviceInfo.ppEnabledExtensionNames = instance.deviceExtensions.data();
   deviceInfo.queueCreateInfoCount = queueCreateInfos.size();
   deviceInfo.pQueueCreateInfos = queueCreateInfos.data();
-  deviceInfo.pNext = &sync2Feat;
+  deviceInfo.pEnabledFeatures = &enabledFeatures;
+  deviceInfo.pNext = presentWait ? static_cast<void*>(&presentIdFeat) : static_cast<void*>(&timelineFeat);
 
   if (vkCreateDevice(instance.physDevice, &deviceInfo, nullptr, &instance.device) != VK_SUCCESS) {
     LOG(F, "Could not create VkDevice.");
   }
+  vkGetDeviceQueue(instance.device, instance.queueFamilies.transferFamily.value(), 0, &instance.transferQueue);
+  LOG(D, "Uploads use " << (hasTransferQueue(instance) ? "a dedicated transfer queue." : "the graphics queue."));
+  if (presentWait)
+    instance.waitForPresent = reinterpret_cast<PFN_vkWaitForPresentKHR>(vkGetDeviceProcAddr(instance.device, "vkWaitForPresentKHR"));
+  LOG(D, "Frame latency is measured " << (instance.waitForPresent ? "with present wait." : "with fences."));
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(instance.physDevice, &properties);
+  const u32 timestampBits = instance.queueFamilies.timestampValidBits;
+  instance.timestampQueries = timestampBits > 0 && properties.limits.timestampPeriod > 0.0f;
+  instance.timestampPeriodNs = properties.limits.timestampPeriod;
+  instance.colorSampleCounts = properties.limits.framebufferColorSampleCounts;
+  instance.depthSampleCounts = properties.limits.framebufferDepthSampleCounts;
+  instance.timestampMask = timestampBits >= 64 ? UINT64_MAX : (1ull << timestampBits) - 1;
+  instance.statisticsQueries = enabledFeatures.pipelineStatisticsQuery;
+  LOG(D, "GPU queries: timestamps " << instance.timestampQueries << ", pipeline statistics " << instance.statisticsQueries);
+
+  setupPipelineCache(instance);
 }
 
 void VkBackend::setupVMA(Instance &instance) {
+  VKUIX_PROFILE_ZONE("VkBackend::setupVMA");
   VmaAllocatorCreateInfo allocCreateInfo{};
   allocCreateInfo.flags = VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
   allocCreateInfo.vulkanApiVersion = VK_API_VERSION_1_3;
@@ -111,26 +218,66 @@ void VkBackend::setupQueues(Instance &instance) {
   int i = 0;
   for (const VkQueueFamilyProperties &qf: queueFamilies) {
     if (qf.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
-      VkBool32 presentSupport = false;
-      vkGetPhysicalDeviceSurfaceSupportKHR(instance.physDevice, i, instance.surface, &presentSupport);
+      // Headless, nothing is presented. The graphics queue stands in as present queue.
+      VkBool32 presentSupport = !instance.surface;
+      if (instance.surface)
+        vkGetPhysicalDeviceSurfaceSupportKHR(instance.physDevice, i, instance.surface, &presentSupport);
       if (presentSupport)
         instance.queueFamilies.presentFamily = i;
       instance.queueFamilies.graphicsFamily = i;
+      instance.queueFamilies.timestampValidBits = qf.timestampValidBits;
       if (instance.queueFamilies.presentFamily && instance.queueFamilies.graphicsFamily)
         break;
     }
     ++i;
   }
+
+  // A transfer only family is usually backed by a DMA engine that copies alongside rendering.
+  for (u32 family = 0; family < queueFamilies.size(); ++family) {
+    const VkQueueFlags flags = queueFamilies[family].queueFlags;
+    if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+      instance.queueFamilies.transferFamily = family;
+      break;
+    }
+  }
+  if (!instance.queueFamilies.transferFamily)
+    instance.queueFamilies.transferFamily = instance.queueFamilies.graphicsFamily;
 }
 
-void VkBackend::setupSwapchain(const sptr<VKUIX::Window>& window, Instance &instance, const bool resize) {
-  // If resize, free resources from old swapchain first.
-  if (resize) {
-    for (const auto image: instance.swapchain.images) {
-      vkDestroyImageView(instance.device, image.view, nullptr);
-      vmaDestroyImage(instance.allocator, image.vkImage, image.alloc);
+static VkPresentModeKHR choosePresentMode(const VkBackend::Instance &instance, const VkPresentModeKHR requested) {
+  u32 modeCount = 0;
+  vkGetPhysicalDeviceSurfacePresentModesKHR(instance.physDevice, instance.surface, &modeCount, nullptr);
+  std::vector<VkPresentModeKHR> modes(modeCount);
+  vkGetPhysicalDeviceSurfacePresentModesKHR(instance.physDevice, instance.surface, &modeCount, modes.data());
+
+  std::vector<VkPresentModeKHR> candidates{requested};
+  if (requested == VK_PRESENT_MODE_MAILBOX_KHR) candidates.push_back(VK_PRESENT_MODE_IMMEDIATE_KHR);
+  else if (requested == VK_PRESENT_MODE_IMMEDIATE_KHR) candidates.push_back(VK_PRESENT_MODE_MAILBOX_KHR);
+
+  for (const VkPresentModeKHR candidate : candidates) {
+    if (std::find(modes.begin(), modes.end(), candidate) != modes.end()) {
+      if (candidate != requested)
+        LOG(W, "Present mode " << requested << " is not supported, falling back to " << candidate << ".");
+      return candidate;
     }
-    vkDestroySwapchainKHR(instance.device, instance.swapchain.swapchain, nullptr);
+  }
+  if (requested != VK_PRESENT_MODE_FIFO_KHR)
+    LOG(W, "Present mode " << requested << " is not supported, falling back to FIFO.");
+  return VK_PRESENT_MODE_FIFO_KHR; // Required to be supported
+}
+
+void VkBackend::setupSwapchain(const sptr<VKUIX::Window>& window, Instance &instance, Retired *retiredOut) {
+  VKUIX_PROFILE_ZONE("VkBackend::setupSwapchain");
+  // Recreation hands the old swapchain over to the new one, frames still in flight keep using its images.
+  const VkSwapchainKHR oldSwapchain = retiredOut ? instance.swapchain.swapchain : VK_NULL_HANDLE;
+  if (retiredOut) {
+    retiredOut->swapchain = oldSwapchain;
+    // Swapchain images are owned by the swapchain, only the views are ours.
+    for (const Image &image : instance.swapchain.images)
+      retiredOut->views.push_back(image.view);
+    retiredOut->semaphores.insert(retiredOut->semaphores.end(), instance.swapchain.renderSemas.begin(), instance.swapchain.renderSemas.end());
+    instance.swapchain.images.clear();
+    instance.swapchain.renderSemas.clear();
   }
 
   VkSurfaceCapabilitiesKHR caps;
@@ -152,11 +299,21 @@ void VkBackend::setupSwapchain(const sptr<VKUIX::Window>& window, Instance &inst
     }
   }
 
-  instance.swapchain.presentMode = VK_PRESENT_MODE_FIFO_KHR;
-  instance.swapchain.extent = window->getExtent();
+  instance.swapchain.presentMode = choosePresentMode(instance, instance.swapchain.requestedPresentMode);
+  // Most platforms dictate the extent, the others take the window's within the surface limits.
+  if (caps.currentExtent.width != UINT32_MAX) {
+    instance.swapchain.extent = caps.currentExtent;
+  } else {
+    const VkExtent2D extent = window->getExtent();
+    instance.swapchain.extent.width = glm::clamp(extent.width, caps.minImageExtent.width, caps.maxImageExtent.width);
+    instance.swapchain.extent.height = glm::clamp(extent.height, caps.minImageExtent.height, caps.maxImageExtent.height);
+  }
 
   u32 imageCount = caps.minImageCount;
-  if (caps.maxImageCount > 0 && caps.minImageCount > caps.maxImageCount)
+  // Mailbox only replaces a queued image if there is one besides the image shown and the one being rendered.
+  if (instance.swapchain.presentMode == VK_PRESENT_MODE_MAILBOX_KHR)
+    imageCount = glm::max(imageCount, 3u);
+  if (caps.maxImageCount > 0 && imageCount > caps.maxImageCount)
     imageCount = caps.maxImageCount;
   instance.swapchain.framebufferingAmount = imageCount;
 
@@ -186,9 +343,8 @@ void VkBackend::setupSwapchain(const sptr<VKUIX::Window>& window, Instance &inst
   swapchainCreateInfo.presentMode = instance.swapchain.presentMode;
   swapchainCreateInfo.clipped = VK_TRUE;
 
-  // This can later be changed if we want to use the old swapchain to create a new one.
-  // Vulkan uses this mainly for performance reasons because swapchain creation can be expensive in certain cases.
-  swapchainCreateInfo.oldSwapchain = VK_NULL_HANDLE;
+  // Lets the driver reuse what it can of the old swapchain and keeps presenting its images until the new ones arrive.
+  swapchainCreateInfo.oldSwapchain = oldSwapchain;
 
   if (vkCreateSwapchainKHR(instance.device, &swapchainCreateInfo, nullptr, &instance.swapchain.swapchain) != VK_SUCCESS) {
     LOG(F, "Could not create VkSwapchain.");
@@ -218,16 +374,229 @@ void VkBackend::setupSwapchain(const sptr<VKUIX::Window>& window, Instance &inst
     }
   }
 
+  instance.swapchain.firstPresentId = instance.swapchain.presentId + 1;
+  instance.swapchain.renderSemas.resize(imageCount);
+  for (VkSemaphore &sema : instance.swapchain.renderSemas)
+    createSemaphore(instance, sema);
+
   LOG(I, "Using Format: " + std::to_string(instance.swapchain.surfaceFormat.format)
                                 .append(" and PresentMode: ")
                                 .append(std::to_string(instance.swapchain.presentMode))
                                 .append("with " + std::to_string(imageCount) + " image count"));
 }
 
+void VkBackend::destroyRetired(const Instance &instance, Retired &retired) {
+  for (const VkImageView view : retired.views)
+    vkDestroyImageView(instance.device, view, nullptr);
+  for (const VkSemaphore sema : retired.semaphores)
+    vkDestroySemaphore(instance.device, sema, nullptr);
+  for (const Image &image : retired.images) {
+    vkDestroyImageView(instance.device, image.view, nullptr);
+    vmaDestroyImage(instance.allocator, image.vkImage, image.alloc);
+  }
+  if (retired.swapchain)
+    vkDestroySwapchainKHR(instance.device, retired.swapchain, nullptr);
+  retired = {};
+}
+
+void VkBackend::destroyInstance(Instance &instance) {
+  // Swapchain images are owned by the swapchain, only the views are ours.
+  for (const Image &image : instance.swapchain.images)
+    vkDestroyImageView(instance.device, image.view, nullptr);
+  instance.swapchain.images.clear();
+  for (const VkSemaphore sema : instance.swapchain.renderSemas)
+    vkDestroySemaphore(instance.device, sema, nullptr);
+  instance.swapchain.renderSemas.clear();
+  if (instance.swapchain.swapchain)
+    vkDestroySwapchainKHR(instance.device, instance.swapchain.swapchain, nullptr);
+
+  destroyPipelineRepository(instance);
+
+  if (instance.pipelineCache) {
+    savePipelineCache(instance);
+    vkDestroyPipelineCache(instance.device, instance.pipelineCache, nullptr);
+  }
+
+  vmaDestroyAllocator(instance.allocator);
+  vkDestroyDevice(instance.device, nullptr);
+  if (instance.surface)
+    vkDestroySurfaceKHR(instance.vkInstance, instance.surface, nullptr);
+  vkDestroyInstance(instance.vkInstance, nullptr);
+  instance = {};
+}
+
+bool VkBackend::hasTransferQueue(const Instance &instance) {
+  return instance.queueFamilies.transferFamily != instance.queueFamilies.graphicsFamily;
+}
+
+bool VkBackend::hasDeviceExtension(const Instance &instance, const char *extension) {
+  for (const char *enabled : instance.deviceExtensions)
+    if (strcmp(enabled, extension) == 0) return true;
+  return false;
+}
+
+// Written in front of the driver's cache data. The driver validates its own header as well, but not every
+// driver rejects data of an older driver version, and none detects a truncated or corrupted payload.
+struct PipelineCacheFileHeader {
+  static constexpr u32 MAGIC = 0x43504B56; // "VKPC"
+  static constexpr u32 VERSION = 1;
+
+  u32 magic;
+  u32 version;
+  u32 vendorID;
+  u32 deviceID;
+  u32 driverVersion;
+  u8 pipelineCacheUUID[VK_UUID_SIZE];
+  u64 dataSize;
+  u64 dataHash;
+};
+
+static u64 pipelineCacheHash(const std::vector<u8> &data) {
+  u64 hash = 0xcbf29ce484222325ull;
+  for (const u8 byte : data) hash = (hash ^ byte) * 0x100000001b3ull;
+  return hash;
+}
+
+static PipelineCacheFileHeader pipelineCacheFileHeader(const VkPhysicalDeviceProperties &properties, const std::vector<u8> &data) {
+  PipelineCacheFileHeader header{PipelineCacheFileHeader::MAGIC, PipelineCacheFileHeader::VERSION,
+                                 properties.vendorID, properties.deviceID, properties.driverVersion};
+  memcpy(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+  header.dataSize = data.size();
+  header.dataHash = pipelineCacheHash(data);
+  return header;
+}
+
+// Reads the cache data of pipelineCachePath. Returns false with a reason if it does not belong to this device and driver.
+static bool readPipelineCacheFile(const std::string &path, const VkPhysicalDeviceProperties &properties,
+                                  std::vector<u8> &dataOut, std::string &reasonOut) {
+  std::ifstream file{path, std::ios::binary | std::ios::ate};
+  if (!file.is_open()) {
+    reasonOut = "no cache file";
+    return false;
+  }
+  const u64 fileSize = file.tellg();
+  file.seekg(0);
+
+  PipelineCacheFileHeader header{};
+  if (fileSize < sizeof(header) || !file.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+    reasonOut = "truncated header";
+    return false;
+  }
+  if (header.magic != PipelineCacheFileHeader::MAGIC || header.version != PipelineCacheFileHeader::VERSION) {
+    reasonOut = "unknown file format";
+    return false;
+  }
+  if (header.vendorID != properties.vendorID || header.deviceID != properties.deviceID ||
+      memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+    reasonOut = "written by another device";
+    return false;
+  }
+  if (header.driverVersion != properties.driverVersion) {
+    reasonOut = "written by another driver version";
+    return false;
+  }
+  if (header.dataSize != fileSize - sizeof(header)) {
+    reasonOut = "size mismatch";
+    return false;
+  }
+
+  dataOut.resize(header.dataSize);
+  if (!file.read(reinterpret_cast<char*>(dataOut.data()), static_cast<std::streamsize>(dataOut.size())) ||
+      pipelineCacheHash(dataOut) != header.dataHash) {
+    reasonOut = "corrupt data";
+    return false;
+  }
+
+  // The driver's own header leads the data, check it matches as well before handing the data over.
+  VkPipelineCacheHeaderVersionOne driverHeader{};
+  if (dataOut.size() < sizeof(driverHeader)) {
+    reasonOut = "truncated driver header";
+    return false;
+  }
+  memcpy(&driverHeader, dataOut.data(), sizeof(driverHeader));
+  if (driverHeader.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE || driverHeader.vendorID != properties.vendorID ||
+      driverHeader.deviceID != properties.deviceID || memcmp(driverHeader.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+    reasonOut = "driver header mismatch";
+    return false;
+  }
+  return true;
+}
+
+void VkBackend::setupPipelineCache(Instance &instance) {
+  VKUIX_PROFILE_ZONE("VkBackend::setupPipelineCache");
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(instance.physDevice, &properties);
+
+  std::vector<u8> data{};
+  std::string reason{};
+  instance.pipelineCacheWarm = !instance.pipelineCachePath.empty() && readPipelineCacheFile(instance.pipelineCachePath, properties, data, reason);
+  if (!instance.pipelineCacheWarm) data.clear();
+
+  VkPipelineCacheCreateInfo cacheInfo{VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO};
+  cacheInfo.initialDataSize = data.size();
+  cacheInfo.pInitialData = data.data();
+  if (vkCreatePipelineCache(instance.device, &cacheInfo, nullptr, &instance.pipelineCache) != VK_SUCCESS) {
+    // Pipelines still work without a cache, they are just compiled from scratch.
+    LOG(W, "Could not create VkPipelineCache.");
+    instance.pipelineCache = VK_NULL_HANDLE;
+    instance.pipelineCacheWarm = false;
+    return;
+  }
+
+  instance.pipelineCacheSavedSize = data.size();
+  if (instance.pipelineCacheWarm)
+    LOG(D, "Loaded pipeline cache " << instance.pipelineCachePath << " (" << data.size() << " bytes).");
+  else
+    LOG(D, "Starting with an empty pipeline cache: " << reason << ".");
+}
+
+bool VkBackend::savePipelineCache(Instance &instance) {
+  if (!instance.pipelineCache || instance.pipelineCachePath.empty()) return false;
+
+  size_t size = 0;
+  if (vkGetPipelineCacheData(instance.device, instance.pipelineCache, &size, nullptr) != VK_SUCCESS) return false;
+  if (size == instance.pipelineCacheSavedSize) return false;
+  VKUIX_PROFILE_ZONE("VkBackend::savePipelineCache");
+
+  std::vector<u8> data(size);
+  if (vkGetPipelineCacheData(instance.device, instance.pipelineCache, &size, data.data()) != VK_SUCCESS) return false;
+  data.resize(size);
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(instance.physDevice, &properties);
+  const PipelineCacheFileHeader header = pipelineCacheFileHeader(properties, data);
+
+  // Renaming over the old file is atomic, a crash mid-write only loses the temporary file.
+  const std::string tempPath = instance.pipelineCachePath + ".tmp";
+  {
+    std::ofstream file{tempPath, std::ios::binary | std::ios::trunc};
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+    file.close();
+    if (!file) {
+      LOG(W, "Could not write pipeline cache " << tempPath);
+      return false;
+    }
+  }
+
+  std::error_code error{};
+  std::filesystem::rename(tempPath, instance.pipelineCachePath, error);
+  if (error) {
+    LOG(W, "Could not replace pipeline cache " << instance.pipelineCachePath << ": " << error.message());
+    std::filesystem::remove(tempPath, error);
+    return false;
+  }
+
+  instance.pipelineCacheSavedSize = data.size();
+  LOG(D, "Saved pipeline cache " << instance.pipelineCachePath << " (" << data.size() << " bytes).");
+  return true;
+}
+
 void VkBackend::createCommandpool(
   Instance& instance,
   VkCommandPool &pool,
-  const VkCommandPoolCreateFlags flags)
+  const VkCommandPoolCreateFlags flags,
+  const std::optional<u32> queueFamily)
 {
   const QueueFamilyInfo& queueInfo = instance.queueFamilies;
 
@@ -235,23 +604,137 @@ void VkBackend::createCommandpool(
 
   VkCommandPoolCreateInfo cmdPoolInfo{VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
   cmdPoolInfo.flags = flags;
-  cmdPoolInfo.queueFamilyIndex = queueInfo.graphicsFamily.value();
+  cmdPoolInfo.queueFamilyIndex = queueFamily.value_or(queueInfo.graphicsFamily.value());
 
   if (vkCreateCommandPool(instance.device, &cmdPoolInfo, nullptr, &pool) != VK_SUCCESS) {
     LOG(F, "Could not create VkCommandPool.");
   }
 }
 
-void VkBackend::createCommandbuffer(const Instance &instance, const VkCommandPool & pool, VkCommandBuffer &buffer) {
+void VkBackend::createCommandbuffer(const Instance &instance, const VkCommandPool & pool, VkCommandBuffer &buffer,
+  const VkCommandBufferLevel level) {
   VkCommandBufferAllocateInfo allocInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
   allocInfo.commandPool = pool;
   allocInfo.commandBufferCount = 1;
-  allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  allocInfo.level = level;
   if (vkAllocateCommandBuffers(instance.device, &allocInfo, &buffer) != VK_SUCCESS) {
     LOG(F, "Could not allocate VkCommandBuffer.");
   }
 }
 
+void VkBackend::createQueryPool(const Instance &instance, QueryPool &pool, const u32 timestampCapacity, const bool statistics) {
+  if (instance.timestampQueries && timestampCapacity > 0) {
+    VkQueryPoolCreateInfo info{VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO};
+    info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    info.queryCount = timestampCapacity;
+    if (vkCreateQueryPool(instance.device, &info, nullptr, &pool.timestamps) != VK_SUCCESS) {
+      LOG(W, "Could not create timestamp VkQueryPool.");
+    } else {
+      pool.capacity = timestampCapacity;
+    }
+  }
+
+  if (instance.statisticsQueries && statistics) {
+    VkQueryPoolCreateInfo info{VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO};
+    info.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+    info.queryCount = 1;
+    info.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT
+                              | VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT
+                              | VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT
+                              | VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+    if (vkCreateQueryPool(instance.device, &info, nullptr, &pool.statistics) != VK_SUCCESS) {
+      LOG(W, "Could not create pipeline statistics VkQueryPool.");
+    }
+  }
+}
+
+void VkBackend::destroyQueryPool(const Instance &instance, QueryPool &pool) {
+  if (pool.timestamps) vkDestroyQueryPool(instance.device, pool.timestamps, nullptr);
+  if (pool.statistics) vkDestroyQueryPool(instance.device, pool.statistics, nullptr);
+  pool = {};
+}
+
+void VkBackend::resetQueryPool(VkCommandBuffer cmdBuffer, const QueryPool &pool) {
+  if (pool.timestamps) vkCmdResetQueryPool(cmdBuffer, pool.timestamps, 0, pool.capacity);
+  if (pool.statistics) vkCmdResetQueryPool(cmdBuffer, pool.statistics, 0, 1);
+}
+
+void VkBackend::clearQueryZones(QueryPool &pool) {
+  pool.count = 0;
+  pool.reserved = 0;
+  pool.zones.clear();
+  pool.open.clear();
+  pool.statisticsWritten = false;
+}
+
+void VkBackend::beginGpuZone(const Instance &instance, VkCommandBuffer cmdBuffer, QueryPool &pool, const char *name) {
+  if (instance.cmdBeginDebugLabel) {
+    VkDebugUtilsLabelEXT label{VK_STRUCTURE_TYPE_DEBUG_UTILS_LABEL_EXT};
+    label.pLabelName = name;
+    instance.cmdBeginDebugLabel(cmdBuffer, &label);
+  }
+
+  if (!pool.timestamps || pool.count + pool.reserved + 2 > pool.capacity) {
+    pool.open.push_back(UINT32_MAX);
+    return;
+  }
+  pool.open.push_back(pool.zones.size());
+  pool.zones.push_back({name, pool.count, 0, static_cast<u32>(pool.open.size() - 1)});
+  vkCmdWriteTimestamp2(cmdBuffer, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT, pool.timestamps, pool.count++);
+  pool.reserved++;
+}
+
+void VkBackend::endGpuZone(const Instance &instance, VkCommandBuffer cmdBuffer, QueryPool &pool) {
+  if (pool.open.empty()) {
+    LOG(W, "endGpuZone without a matching beginGpuZone.");
+    return;
+  }
+
+  const u32 zone = pool.open.back();
+  pool.open.pop_back();
+  if (zone != UINT32_MAX) {
+    pool.zones[zone].end = pool.count;
+    vkCmdWriteTimestamp2(cmdBuffer, VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT, pool.timestamps, pool.count++);
+    pool.reserved--;
+  }
+
+  if (instance.cmdEndDebugLabel) instance.cmdEndDebugLabel(cmdBuffer);
+}
+
+void VkBackend::beginPipelineStatistics(VkCommandBuffer cmdBuffer, QueryPool &pool) {
+  if (!pool.statistics) return;
+  vkCmdBeginQuery(cmdBuffer, pool.statistics, 0, 0);
+  pool.statisticsWritten = true;
+}
+
+void VkBackend::endPipelineStatistics(VkCommandBuffer cmdBuffer, const QueryPool &pool) {
+  if (pool.statisticsWritten) vkCmdEndQuery(cmdBuffer, pool.statistics, 0);
+}
+
+bool VkBackend::readQueries(const Instance &instance, const QueryPool &pool, std::vector<GpuZoneTiming> &timingsOut, GpuStatistics &statisticsOut) {
+  if (pool.count > 0) {
+    std::vector<u64> timestamps(pool.count);
+    if (vkGetQueryPoolResults(instance.device, pool.timestamps, 0, pool.count, timestamps.size() * sizeof(u64), timestamps.data(),
+                              sizeof(u64), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+      return false;
+
+    for (const GpuZone &zone : pool.zones) {
+      // Only the valid bits count, the difference wraps within them.
+      const u64 ticks = (timestamps[zone.end] - timestamps[zone.begin]) & instance.timestampMask;
+      timingsOut.push_back({zone.name, zone.depth, static_cast<double>(ticks) * instance.timestampPeriodNs / 1e6});
+    }
+  }
+
+  if (pool.statisticsWritten) {
+    // Results are ordered by statistic bit: vertices, vertex invocations, clipping primitives, fragment invocations.
+    u64 results[4]{};
+    if (vkGetQueryPoolResults(instance.device, pool.statistics, 0, 1, sizeof(results), results, sizeof(results), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+      return false;
+    statisticsOut = {results[0], results[1], results[2], results[3]};
+  }
+  return true;
+}
+
 void VkBackend::createFence(const Instance &instance, VkFence &fenceOut) {
 
   VkFenceCreateInfo fenceInfo{VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
@@ -281,25 +764,38 @@ void VkBackend::createImage(const Instance &instance, Image &image) {
   imageInfo.mipLevels = 1;
   imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
   imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-  imageInfo.usage = image.usageFlags;
+  imageInfo.usage = image.transient ? image.usageFlags | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT : image.usageFlags;
+  // Concurrent instead of a queue family ownership transfer, the image is written once and only read afterwards.
+  const u32 families[] = {instance.queueFamilies.graphicsFamily.value(), instance.queueFamilies.transferFamily.value()};
+  if (image.uploadTarget && hasTransferQueue(instance)) {
+    imageInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+    imageInfo.queueFamilyIndexCount = 2;
+    imageInfo.pQueueFamilyIndices = families;
+  }
 
   VmaAllocationCreateInfo allocInfo{};
   allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
   allocInfo.requiredFlags = static_cast<VkMemoryPropertyFlags>(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-  if (vmaCreateImage(instance.allocator, &imageInfo, &allocInfo, &image.vkImage, &image.alloc, nullptr) != VK_SUCCESS) {
-    LOG(W, "Could not create VkImage.");
+  VmaAllocationCreateInfo lazyInfo{};
+  lazyInfo.usage = VMA_MEMORY_USAGE_GPU_LAZILY_ALLOCATED;
+  // Most desktop GPUs have no lazily allocated memory, the image then takes regular device memory.
+  if (!image.transient || vmaCreateImage(instance.allocator, &imageInfo, &lazyInfo, &image.vkImage, &image.alloc, nullptr) != VK_SUCCESS) {
+    if (vmaCreateImage(instance.allocator, &imageInfo, &allocInfo, &image.vkImage, &image.alloc, nullptr) != VK_SUCCESS) {
+      LOG(W, "Could not create VkImage.");
+    }
   }
 
   VkImageViewCreateInfo imageViewInfo{VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
   imageViewInfo.image = image.vkImage;
   imageViewInfo.format = image.format;
   imageViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  imageViewInfo.components = image.swizzle;
   imageViewInfo.subresourceRange.baseMipLevel = 0;
   imageViewInfo.subresourceRange.levelCount = 1;
   imageViewInfo.subresourceRange.baseArrayLayer = 0;
   imageViewInfo.subresourceRange.layerCount = 1;
-  imageViewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  imageViewInfo.subresourceRange.aspectMask = image.format == DEPTH_FORMAT ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
 
   if (vkCreateImageView(instance.device, &imageViewInfo, nullptr, &image.view) != VK_SUCCESS) {
     LOG(W, "Could not create VkImageView from VkImage.");
@@ -308,10 +804,27 @@ void VkBackend::createImage(const Instance &instance, Image &image) {
 }
 
 
+void VkBackend::createSampler(const Instance &instance, const VkFilter filter, VkSampler &samplerOut) {
+
+  VkSamplerCreateInfo samplerInfo{VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
+  samplerInfo.magFilter = filter;
+  samplerInfo.minFilter = filter;
+  samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+  samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.maxLod = 0.0f;
+
+  if (vkCreateSampler(instance.device, &samplerInfo, nullptr, &samplerOut) != VK_SUCCESS) {
+    LOG(W, "Could not create VkSampler.");
+  }
+
+}
+
 void VkBackend::transitionImage(VkCommandBuffer &cmdBuffer, VkImage &image,
   VkPipelineStageFlags2 srcStage, VkAccessFlags2 srcAccessMask,
   VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccessMask,
-  VkImageLayout oldLayout, VkImageLayout newLayout) {
+  VkImageLayout oldLayout, VkImageLayout newLayout, VkImageAspectFlags aspect) {
 
   VkImageMemoryBarrier2 imageBarrier{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2};
   imageBarrier.srcStageMask = srcStage;
@@ -323,7 +836,7 @@ void VkBackend::transitionImage(VkCommandBuffer &cmdBuffer, VkImage &image,
   imageBarrier.oldLayout = oldLayout;
   imageBarrier.newLayout = newLayout;
   imageBarrier.image = image;
-  imageBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  imageBarrier.subresourceRange.aspectMask = aspect;
   imageBarrier.subresourceRange.baseMipLevel = 0;
   imageBarrier.subresourceRange.levelCount = 1;
   imageBarrier.subresourceRange.baseArrayLayer = 0;
@@ -411,39 +924,63 @@ void VkBackend::createRenderpass(const Instance &instance, RenderpassInfo &rpInf
 
 }
 
-void VkBackend::createDynamicGraphicsPipeline(const Instance &instance, Shader &shader,
-  std::vector<VkDescriptorSetLayout> &layouts, VkPipeline &dynamicPipeline, VkPipelineLayout &pipelineLayout) {
-
-  VkPipelineLayoutCreateInfo pipelineLayoutInfo{VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
-  pipelineLayoutInfo.setLayoutCount = layouts.size();
-  pipelineLayoutInfo.pSetLayouts = layouts.data();
+VkBackend::VertexInputDescription VkBackend::describeVertexFormat(const VertexFormat format) {
+  switch (format) {
+    case VertexFormat::QuantizedVertex: return describeVertex<QuantizedVertex>();
+    case VertexFormat::RectInstance: return describeVertex<RectInstance>();
+    case VertexFormat::TexturedInstance: return describeVertex<TexturedInstance>();
+    default: return describeVertex<Vertex>();
+  }
+}
 
-  VkPushConstantRange pushConstant{};
-  pushConstant.offset = 0;
-  pushConstant.size = sizeof(DefaultPushConstant);
-  pushConstant.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+u64 VkBackend::PipelineDesc::hash() const {
+  u64 hash = 0xcbf29ce484222325ull;
+  for (const char c : shader) hash = (hash ^ static_cast<u8>(c)) * 0x100000001b3ull;
+  for (const u64 word : {static_cast<u64>(vertexFormat), static_cast<u64>(blend), static_cast<u64>(samples), static_cast<u64>(topology),
+                         static_cast<u64>(edgeAA), static_cast<u64>(opaquePass)})
+    hash = (hash ^ word) * 0x100000001b3ull;
+  return hash;
+}
 
-  pipelineLayoutInfo.pushConstantRangeCount = 1;
-  pipelineLayoutInfo.pPushConstantRanges = &pushConstant;
+bool VkBackend::PipelineDesc::compatible(const PipelineDesc &other) const {
+  return vertexFormat == other.vertexFormat && samples == other.samples && topology == other.topology && opaquePass == other.opaquePass;
+}
 
-  if (vkCreatePipelineLayout(instance.device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
-    LOG(F, "Could not create corresponding VkPipelineLayout for VkPipeline. Aborting VkPipeline creation.");
-  }
+bool VkBackend::PipelineDesc::operator==(const PipelineDesc &other) const {
+  return compatible(other) && blend == other.blend && edgeAA == other.edgeAA && shader == other.shader;
+}
 
-  VkFormat depthFormat = VK_FORMAT_D32_SFLOAT;
+bool VkBackend::createDynamicGraphicsPipeline(const Instance &instance, const PipelineDesc &desc, const VkPipelineLayout layout,
+                                              VkPipeline &pipelineOut) {
+  VKUIX_PROFILE_ZONE("VkBackend::createDynamicGraphicsPipeline");
 
+  Shader shader{instance.device, desc.shader};
   std::array<VkPipelineShaderStageCreateInfo, 2> shaderStageInfos = shader.getShaderStageInfos();
 
+  // Shaders without the constants ignore them. Each stage has one VkBool32 at id 0: edgeAA for the fragment, opaquePass for the vertex stage.
+  const VkBool32 edgeAA = desc.edgeAA ? VK_TRUE : VK_FALSE;
+  const VkBool32 opaquePass = desc.opaquePass ? VK_TRUE : VK_FALSE;
+  const VkSpecializationMapEntry boolEntry{0, 0, sizeof(VkBool32)};
+  VkSpecializationInfo fragSpecialization{};
+  fragSpecialization.mapEntryCount = 1;
+  fragSpecialization.pMapEntries = &boolEntry;
+  fragSpecialization.dataSize = sizeof(VkBool32);
+  fragSpecialization.pData = &edgeAA;
+  shaderStageInfos[1].pSpecializationInfo = &fragSpecialization;
+  VkSpecializationInfo vertSpecialization = fragSpecialization;
+  vertSpecialization.pData = &opaquePass;
+  shaderStageInfos[0].pSpecializationInfo = &vertSpecialization;
+
   // Vertex Input Info eg. Position (XY later Z), Color (RGBA)
   VkPipelineVertexInputStateCreateInfo inputInfo{VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO};
-  VertexInputDescription vertexInputDescription = Vertex::getVertexDescription();
+  const VertexInputDescription vertexInputDescription = describeVertexFormat(desc.vertexFormat);
   inputInfo.vertexBindingDescriptionCount = vertexInputDescription.bindings.size();
   inputInfo.pVertexBindingDescriptions = vertexInputDescription.bindings.data();
   inputInfo.vertexAttributeDescriptionCount = vertexInputDescription.attributes.size();
   inputInfo.pVertexAttributeDescriptions = vertexInputDescription.attributes.data();
 
   VkPipelineInputAssemblyStateCreateInfo inputAssembly{VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO};
-  inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+  inputAssembly.topology = desc.topology;
   inputAssembly.primitiveRestartEnable = VK_FALSE;
 
   VkPipelineRasterizationStateCreateInfo raster{VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO};
@@ -456,17 +993,25 @@ void VkBackend::createDynamicGraphicsPipeline(const Instance &instance, Shader &
   raster.lineWidth = 1.0f;
 
   VkPipelineMultisampleStateCreateInfo multisample{VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO};
-  multisample.rasterizationSamples = ANTI_ALIASING_COUNT;
+  multisample.rasterizationSamples = desc.samples;
 
   VkPipelineDepthStencilStateCreateInfo depthStencil{VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO};
+  // Opaque draws overwrite what they cover, so later instances of the same draw win at equal depth.
+  // The translucent pass only blends over what is behind it, which leaves out the interiors the opaque pass drew for the same draw.
   depthStencil.depthTestEnable = VK_TRUE;
-  depthStencil.depthWriteEnable = VK_TRUE;
-  depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+  depthStencil.depthWriteEnable = desc.opaquePass ? VK_TRUE : VK_FALSE;
+  depthStencil.depthCompareOp = desc.opaquePass ? VK_COMPARE_OP_LESS_OR_EQUAL : VK_COMPARE_OP_LESS;
   depthStencil.depthBoundsTestEnable = VK_FALSE;
   depthStencil.stencilTestEnable = VK_FALSE;
 
   VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-  colorBlendAttachment.blendEnable = VK_FALSE;
+  colorBlendAttachment.blendEnable = desc.blend != BlendMode::Opaque ? VK_TRUE : VK_FALSE;
+  colorBlendAttachment.srcColorBlendFactor = desc.blend == BlendMode::Premultiplied ? VK_BLEND_FACTOR_ONE : VK_BLEND_FACTOR_SRC_ALPHA;
+  colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+  colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+  colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+  colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+  colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
   colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
 
   VkPipelineColorBlendStateCreateInfo colorBlend{VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO};
@@ -489,7 +1034,7 @@ void VkBackend::createDynamicGraphicsPipeline(const Instance &instance, Shader &
   VkPipelineRenderingCreateInfo renderingInfo{VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO};
   renderingInfo.colorAttachmentCount = 1;
   renderingInfo.pColorAttachmentFormats = &VkBackend::COLOR_FORMAT;
-  renderingInfo.depthAttachmentFormat = depthFormat;
+  renderingInfo.depthAttachmentFormat = DEPTH_FORMAT;
   renderingInfo.stencilAttachmentFormat = VK_FORMAT_UNDEFINED;
 
   VkGraphicsPipelineCreateInfo pipelineInfo{VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO};
@@ -503,17 +1048,130 @@ void VkBackend::createDynamicGraphicsPipeline(const Instance &instance, Shader &
   pipelineInfo.pDepthStencilState = &depthStencil;
   pipelineInfo.pColorBlendState = &colorBlend;
   pipelineInfo.pDynamicState = &dynamicState;
-  pipelineInfo.layout = pipelineLayout; // TODO: Create a pipeline layout.
+  pipelineInfo.layout = layout;
   pipelineInfo.renderPass = VK_NULL_HANDLE;
   pipelineInfo.subpass = 0;
   pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
   pipelineInfo.pNext = &renderingInfo; // Use dynamic render info.
 
-  if (vkCreateGraphicsPipelines(instance.device, nullptr, 1, &pipelineInfo, nullptr, &dynamicPipeline)
-    != VK_SUCCESS) {
-    LOG(F, "Could not create VkPipeline.");
+  // Both the pipeline cache and the device are internally synchronized, so this may run on the compiler thread.
+  const bool created = vkCreateGraphicsPipelines(instance.device, instance.pipelineCache, 1, &pipelineInfo, nullptr, &pipelineOut) == VK_SUCCESS;
+  shader.destroy(instance.device);
+  if (!created) {
+    LOG(E, "Could not create VkPipeline for shader " << desc.shader << ".");
+    pipelineOut = VK_NULL_HANDLE;
+  }
+  return created;
+}
+
+// Compiles queued variants one at a time. Waiting callers are woken after every variant.
+static void pipelineCompilerLoop(VkBackend::Instance *instance) {
+  VKUIX_PROFILE_THREAD("pipeline compiler");
+  VkBackend::PipelineRepository &repository = *instance->pipelineRepository;
+
+  while (true) {
+    u64 key;
+    VkBackend::PipelineDesc desc;
+    {
+      std::unique_lock lock{repository.mutex};
+      repository.wake.wait(lock, [&] { return repository.stopping || !repository.queue.empty(); });
+      if (repository.stopping) return;
+      key = repository.queue.front();
+      repository.queue.pop_front();
+      desc = repository.variants.at(key).desc;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    VkPipeline pipeline{};
+    const bool created = VkBackend::createDynamicGraphicsPipeline(*instance, desc, repository.layout, pipeline);
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    LOG(D, "Compiled pipeline variant " << desc.shader << " " << std::hex << key << std::dec << " in " << ms << " ms.");
+
+    {
+      std::lock_guard lock{repository.mutex};
+      VkBackend::PipelineVariant &variant = repository.variants.at(key);
+      variant.pipeline = pipeline;
+      variant.failed = !created;
+      variant.queued = false;
+    }
+    repository.compiled.notify_all();
   }
+}
+
+void VkBackend::setupPipelineRepository(Instance &instance, const std::vector<VkDescriptorSetLayout> &layouts) {
+  instance.pipelineRepository = std::make_unique<PipelineRepository>();
+  PipelineRepository &repository = *instance.pipelineRepository;
+
+  VkPipelineLayoutCreateInfo pipelineLayoutInfo{VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
+  pipelineLayoutInfo.setLayoutCount = layouts.size();
+  pipelineLayoutInfo.pSetLayouts = layouts.data();
 
+  VkPushConstantRange pushConstant{};
+  pushConstant.offset = 0;
+  pushConstant.size = sizeof(DefaultPushConstant);
+  pushConstant.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+  pipelineLayoutInfo.pushConstantRangeCount = 1;
+  pipelineLayoutInfo.pPushConstantRanges = &pushConstant;
+
+  if (vkCreatePipelineLayout(instance.device, &pipelineLayoutInfo, nullptr, &repository.layout) != VK_SUCCESS) {
+    LOG(F, "Could not create the VkPipelineLayout shared by all pipeline variants.");
+  }
+
+  repository.compiler = std::thread{pipelineCompilerLoop, &instance};
+}
+
+void VkBackend::destroyPipelineRepository(Instance &instance) {
+  if (!instance.pipelineRepository) return;
+  PipelineRepository &repository = *instance.pipelineRepository;
+
+  {
+    std::lock_guard lock{repository.mutex};
+    repository.stopping = true;
+  }
+  repository.wake.notify_all();
+  if (repository.compiler.joinable()) repository.compiler.join();
+
+  for (const PipelineVariant &variant : repository.variants | std::views::values)
+    if (variant.pipeline) vkDestroyPipeline(instance.device, variant.pipeline, nullptr);
+  vkDestroyPipelineLayout(instance.device, repository.layout, nullptr);
+  instance.pipelineRepository.reset();
+}
+
+VkPipeline VkBackend::getPipeline(Instance &instance, const PipelineDesc &desc, const bool allowFallback) {
+  PipelineRepository &repository = *instance.pipelineRepository;
+  const u64 key = desc.hash();
+
+  std::unique_lock lock{repository.mutex};
+  auto [it, inserted] = repository.variants.try_emplace(key);
+  PipelineVariant &variant = it->second;
+  if (inserted) {
+    variant.desc = desc;
+    variant.queued = true;
+    repository.queue.push_back(key);
+    repository.wake.notify_one();
+  } else if (!(variant.desc == desc)) {
+    LOG_FIRST(W, 1, "Pipeline descriptor hash collision for shader " << desc.shader << ".");
+  }
+  if (variant.pipeline || variant.failed) return variant.pipeline;
+
+  if (allowFallback) {
+    VkPipeline fallback = VK_NULL_HANDLE;
+    for (const PipelineVariant &other : repository.variants | std::views::values) {
+      if (!other.pipeline || !other.desc.compatible(desc)) continue;
+      fallback = other.pipeline;
+      if (other.desc.shader == desc.shader) break;
+    }
+    if (fallback) return fallback;
+  }
+
+  // Nothing can stand in, so this has to wait. Moving the variant to the front keeps that wait short.
+  if (variant.queued) {
+    std::erase(repository.queue, key);
+    repository.queue.push_front(key);
+  }
+  repository.compiled.wait(lock, [&] { return variant.pipeline || variant.failed; });
+  return variant.pipeline;
 }
 
 
@@ -1,5 +1,13 @@
 #pragma once
 
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+
 #include <glm/glm.hpp>
 
 #include "vma/vk_mem_alloc.h"
@@ -7,22 +15,38 @@
 #include "common.h"
 #include "image_types.h"
 #include "shader.h"
+#include "vertex.h"
 #include "window.h"
 
 namespace VkBackend {
 
   inline constexpr bool VALIDATION = false;
-  inline constexpr VkSampleCountFlagBits ANTI_ALIASING_COUNT = VK_SAMPLE_COUNT_8_BIT;
   inline constexpr VkFormat COLOR_FORMAT = VK_FORMAT_B8G8R8A8_UNORM;
+  inline constexpr VkFormat DEPTH_FORMAT = VK_FORMAT_D32_SFLOAT;
+
+  // Pipeline cache file, relative to the working directory.
+  inline constexpr const char *PIPELINE_CACHE_FILE = "vkuix_pipeline.cache";
 
   const std::vector<const char*> VAL_LAYERS = {
       "VK_LAYER_KHRONOS_validation"}; // This val layer leaks memory, cant get messages to show up that would justify
 
   const std::vector DEVICE_EXT = {
-      VK_KHR_SWAPCHAIN_EXTENSION_NAME,
       VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME,
       VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME};
 
+  // Only enabled when presenting to a surface.
+  const std::vector PRESENT_DEVICE_EXT = {
+      VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+
+  // Enabled with a surface when the device supports them, check with hasDeviceExtension().
+  const std::vector OPTIONAL_PRESENT_DEVICE_EXT = {
+      VK_KHR_INCREMENTAL_PRESENT_EXTENSION_NAME};
+
+  // Enabled together with their features when the device supports all of them, see Instance::waitForPresent.
+  const std::vector PRESENT_WAIT_DEVICE_EXT = {
+      VK_KHR_PRESENT_ID_EXTENSION_NAME,
+      VK_KHR_PRESENT_WAIT_EXTENSION_NAME};
+
   inline std::vector<const char *> getDefaultInstanceExt() {
     u32 EXT_COUNT = 0;
     const char **GLFW_EXT = glfwGetRequiredInstanceExtensions(&EXT_COUNT);
@@ -31,6 +55,11 @@ namespace VkBackend {
     return EXTENSIONS;
   }
 
+  // Without a window nothing is presented, so no surface extensions are needed.
+  inline std::vector<const char *> getHeadlessInstanceExt() {
+    return {VK_EXT_DEBUG_UTILS_EXTENSION_NAME};
+  }
+
   // Error callback
   static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
       VkDebugUtilsMessageSeverityFlagBitsEXT mesSever,
@@ -44,17 +73,82 @@ namespace VkBackend {
   struct QueueFamilyInfo {
     std::optional<u32> presentFamily;
     std::optional<u32> graphicsFamily;
+    u32 timestampValidBits{0}; // Of the graphics family, 0 means no timestamp support
+    std::optional<u32> transferFamily; // Transfer only family if the device has one, the graphics family otherwise
   };
 
   struct Swapchain {
     VkSwapchainKHR swapchain;
     VkSurfaceFormatKHR surfaceFormat;
-    VkPresentModeKHR presentMode;
+    VkPresentModeKHR requestedPresentMode{VK_PRESENT_MODE_FIFO_KHR};
+    VkPresentModeKHR presentMode; // requestedPresentMode or its fallback, see setupSwapchain
     VkExtent2D extent;
 
+    // Present ids keep increasing across swapchains. The ones before firstPresentId went to an earlier swapchain.
+    u64 presentId{0}; // Of the last present
+    u64 firstPresentId{1};
+
     u32 framebufferingAmount{0};
 
     std::vector<Image> images;
+    // Per image, signaled by the submission rendering into it and waited for by its present. Indexed by image rather
+    // than frame slot: the semaphore is only free again once the image was presented and acquired once more.
+    std::vector<VkSemaphore> renderSemas;
+  };
+
+  // Pipeline variants
+  enum class BlendMode : u8 {
+    Opaque = 0,
+    Alpha = 1, // Straight alpha, src * a + dst * (1 - a)
+    Premultiplied = 2, // src + dst * (1 - a)
+  };
+
+  enum class VertexFormat : u8 {
+    Vertex = 0,
+    QuantizedVertex = 1,
+    RectInstance = 2,
+    TexturedInstance = 3,
+  };
+  VertexInputDescription describeVertexFormat(VertexFormat format);
+
+  // Everything a pipeline variant is created from. Equal descriptors share one VkPipeline.
+  struct PipelineDesc {
+    std::string shader{"default"}; // Name in assets/shader
+    VertexFormat vertexFormat{VertexFormat::Vertex};
+    BlendMode blend{BlendMode::Opaque};
+    VkSampleCountFlagBits samples{VK_SAMPLE_COUNT_1_BIT};
+    VkPrimitiveTopology topology{VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST};
+    // Analytic edge antialiasing in shaders that compute a coverage, specialization constant 0 of the fragment stage.
+    bool edgeAA{true};
+    // Drawn in the opaque pass: writes depth and tests it with LESS_OR_EQUAL. Specialization constant 0 of the vertex stage,
+    // shaders with an antialiased edge shrink their geometry to the part they fully cover. Otherwise depth is only tested, with LESS.
+    bool opaquePass{false};
+
+    [[nodiscard]] u64 hash() const;
+    // Valid in the same draws as other: same vertex input, topology, sample count and depth state, only shading and blending differ.
+    [[nodiscard]] bool compatible(const PipelineDesc &other) const;
+    bool operator==(const PipelineDesc &other) const;
+  };
+
+  struct PipelineVariant {
+    PipelineDesc desc{};
+    VkPipeline pipeline{}; // Null while compiling
+    bool failed{false};
+    bool queued{false};
+  };
+
+  // Pipeline variants keyed by PipelineDesc::hash, all sharing one layout. Missing variants are compiled
+  // by a background thread, see getPipeline. Everything but layout is guarded by mutex.
+  struct PipelineRepository {
+    VkPipelineLayout layout{};
+
+    std::mutex mutex{};
+    std::condition_variable wake{}; // Compiler thread, new work or stopping
+    std::condition_variable compiled{}; // Waiting callers, a variant finished
+    std::unordered_map<u64, PipelineVariant> variants{};
+    std::deque<u64> queue{};
+    bool stopping{false};
+    std::thread compiler{};
   };
 
   struct Instance {
@@ -65,91 +159,181 @@ namespace VkBackend {
 
     QueueFamilyInfo queueFamilies;
     VkQueue graphicsQueue{};
+    VkQueue transferQueue{}; // The graphics queue without a transfer only family
 
     VmaAllocator allocator{};
 
-    Swapchain swapchain{};
-
-    std::unordered_map<const char*, VkPipeline> pipelineRepository{};
-  };
-
-  struct VertexInputDescription {
-    std::vector<VkVertexInputBindingDescription> bindings;
-    std::vector<VkVertexInputAttributeDescription> attributes;
-  };
+    std::vector<const char*> deviceExtensions{}; // DEVICE_EXT, plus the present extensions with a surface
 
-  struct Vertex {
-    glm::vec2 pos;
-    glm::vec4 col;
-    u32 tex_id = 0;
+    // GPU query support, see QueryPool.
+    bool timestampQueries{false};
+    bool statisticsQueries{false};
+    double timestampPeriodNs{1.0};
+    u64 timestampMask{0};
 
-    static VertexInputDescription getVertexDescription() {
-      VertexInputDescription description{};
-      description.bindings.reserve(1);
+    VkSampleCountFlags colorSampleCounts{VK_SAMPLE_COUNT_1_BIT}; // Sample counts color attachments support
+    VkSampleCountFlags depthSampleCounts{VK_SAMPLE_COUNT_1_BIT}; // Sample counts DEPTH_FORMAT attachments support
 
-      // Binding | 0
-      VkVertexInputBindingDescription binding0{};
-      binding0.binding = 0;
-      binding0.stride = sizeof(Vertex);
-      binding0.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-      description.bindings.push_back(binding0);
+    // VK_EXT_debug_utils command labels, null when the instance was created without the extension.
+    PFN_vkCmdBeginDebugUtilsLabelEXT cmdBeginDebugLabel{};
+    PFN_vkCmdEndDebugUtilsLabelEXT cmdEndDebugLabel{};
+    // VK_KHR_present_wait, null when the device does not support it or was created without a surface.
+    PFN_vkWaitForPresentKHR waitForPresent{};
 
-      // Vertex Position Attribute | Loc: 0
-      VkVertexInputAttributeDescription posAttrib{};
-      posAttrib.binding = 0;
-      posAttrib.location = 0;
-      posAttrib.format = VK_FORMAT_R32G32_SFLOAT;
-      posAttrib.offset = offsetof(Vertex, pos);
-
-      // Vertex Color Attribute | Loc: 1
-      VkVertexInputAttributeDescription colAttrib{};
-      colAttrib.binding = 0;
-      colAttrib.location = 1;
-      colAttrib.format = VK_FORMAT_R32G32B32A32_SFLOAT;
-      colAttrib.offset = offsetof(Vertex, col);
-
-      description.attributes.push_back(posAttrib);
-      description.attributes.push_back(colAttrib);
+    Swapchain swapchain{};
 
-      return description;
-    }
+    // Every pipeline is compiled through this cache. Seeded from pipelineCachePath in setupDevices, see savePipelineCache.
+    VkPipelineCache pipelineCache{};
+    std::string pipelineCachePath{PIPELINE_CACHE_FILE};
+    bool pipelineCacheWarm{false}; // Seeded from a valid file
+    size_t pipelineCacheSavedSize{0}; // Size of the data written by the last save
 
+    uptr<PipelineRepository> pipelineRepository{}; // Created by setupPipelineRepository
   };
 
   struct DefaultPushConstant {
     glm::mat4 model;
     glm::mat4 view;
     glm::mat4 proj;
+    float depthStep; // Between the instances of a RoundRect draw, see VKUIX::DrawBatcher::depthStep
   };
 
   void setupInstance(Instance &instance, const std::vector<const char *>& extensions);
   void setupSurface(Instance &instance, GLFWwindow *pWin);
+  // Present support is only required when setupSurface was called before.
   void setupDevices(Instance &instance);
   void setupVMA(Instance &instance);
   void setupQueues(Instance &instance);
-  void setupSwapchain(const sptr<VKUIX::Window> &window, Instance &instance, bool resize = false);
+  // Objects replaced while submissions may still use them, destroyed by destroyRetired once those have completed.
+  struct Retired {
+    u64 frame{0}; // Submissions up to and including this one may use the objects
+    VkSwapchainKHR swapchain{};
+    std::vector<VkImageView> views{};
+    std::vector<VkSemaphore> semaphores{};
+    std::vector<Image> images{}; // Allocated with createImage
+  };
+  void destroyRetired(const Instance &instance, Retired &retired);
+
+  // Uses swapchain.requestedPresentMode if the surface supports it, otherwise the closest supported mode:
+  // MAILBOX falls back to IMMEDIATE, IMMEDIATE to MAILBOX and FIFO_RELAXED to FIFO, which is always there.
+  // With retiredOut, the swapchain is recreated from the current one, which goes into retiredOut together with its views
+  // and semaphores. Nothing waits for the device, the caller destroys them once the frames using them have completed.
+  void setupSwapchain(const sptr<VKUIX::Window> &window, Instance &instance, Retired *retiredOut = nullptr);
+  void destroyInstance(Instance &instance);
+  bool hasDeviceExtension(const Instance &instance, const char *extension);
+  // Whether uploads go through a transfer only queue family. Resources both queues use are then created concurrent.
+  bool hasTransferQueue(const Instance &instance);
+
+  // Creates instance.pipelineCache, seeded from pipelineCachePath if the file was written by the same device and driver.
+  // Called by setupDevices, a missing, stale or corrupt file just leaves the cache empty.
+  void setupPipelineCache(Instance &instance);
+  // Writes the cache into a temporary file and renames it over pipelineCachePath, so readers never see a torn file.
+  // Skipped when the cache did not change size since the last save. Returns true if the file was written.
+  bool savePipelineCache(Instance &instance);
 
   // Command methods
-  void createCommandpool(Instance &instance, VkCommandPool &pool, VkCommandPoolCreateFlags flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
-  void createCommandbuffer(const Instance &instance, const VkCommandPool &pool, VkCommandBuffer &buffer);
+  // For the graphics family unless queueFamily is given.
+  void createCommandpool(Instance &instance, VkCommandPool &pool, VkCommandPoolCreateFlags flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+                         std::optional<u32> queueFamily = std::nullopt);
+  void createCommandbuffer(const Instance &instance, const VkCommandPool &pool, VkCommandBuffer &buffer,
+    VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+
+  // Query methods
+  // Named GPU zones, each a pair of timestamps wrapped in a debug utils label of the same name,
+  // plus an optional pipeline statistics query. Zones nest, depth is the nesting level.
+  struct GpuZone {
+    const char *name; // Must outlive the pool, string literals only
+    u32 begin;
+    u32 end;
+    u32 depth;
+  };
+
+  struct GpuZoneTiming {
+    const char *name;
+    u32 depth;
+    double ms;
+  };
+
+  struct GpuStatistics {
+    u64 vertices{0};
+    u64 vertexInvocations{0};
+    u64 clippedPrimitives{0};
+    u64 fragmentInvocations{0};
+  };
+
+  // Queries written by one command buffer. The GPU side has to be reset with resetQueryPool before every submission,
+  // the recorded zones stay valid as long as the command buffer is not re-recorded, see clearQueryZones.
+  // Results are read with readQueries once the submission's fence has signaled, so reading never waits on the GPU.
+  struct QueryPool {
+    VkQueryPool timestamps{};
+    VkQueryPool statistics{};
+    u32 capacity{0};
+    u32 count{0}; // Timestamps written since clearQueryZones
+    u32 reserved{0}; // Kept free for the end of every open zone
+    std::vector<GpuZone> zones{};
+    std::vector<u32> open{}; // Index into zones, UINT32_MAX for zones that did not fit
+    bool statisticsWritten{false};
+  };
+  void createQueryPool(const Instance &instance, QueryPool &pool, u32 timestampCapacity, bool statistics);
+  void destroyQueryPool(const Instance &instance, QueryPool &pool);
+  // Has to be recorded outside of a render pass instance.
+  void resetQueryPool(VkCommandBuffer cmdBuffer, const QueryPool &pool);
+  void clearQueryZones(QueryPool &pool);
+  // Zones that do not fit into the pool anymore only get their label.
+  void beginGpuZone(const Instance &instance, VkCommandBuffer cmdBuffer, QueryPool &pool, const char *name);
+  void endGpuZone(const Instance &instance, VkCommandBuffer cmdBuffer, QueryPool &pool);
+  void beginPipelineStatistics(VkCommandBuffer cmdBuffer, QueryPool &pool);
+  void endPipelineStatistics(VkCommandBuffer cmdBuffer, const QueryPool &pool);
+  // Appends the zone timings in begin order. Returns false if the results are not available.
+  bool readQueries(const Instance &instance, const QueryPool &pool, std::vector<GpuZoneTiming> &timingsOut, GpuStatistics &statisticsOut);
+
+  // Secondary command buffer with the draws of one layer, re-executed while the recorded commands stay the same.
+  struct LayerCommands {
+    VkCommandBuffer buffer{};
+    u64 hash{0}; // Of everything recorded into buffer
+    bool valid{false};
+    QueryPool queries{};
+  };
 
   // Sync object methods
   struct RenderFrame {
     VkCommandBuffer commandBuffer;
     VkFence renderFence;
-    VkSemaphore renderSema;
-    VkSemaphore presentSema;
+    VkSemaphore acquireSema; // Signaled once the acquired swapchain image can be rendered into
+
+    // Draws of this frame, one secondary per layer. Layer i is allocated from recordPools[i % recordPools.size()]
+    // and only ever recorded by the worker owning that pool.
+    std::vector<VkCommandPool> recordPools{};
+    std::vector<LayerCommands> layers{};
+    u32 layerCount{0}; // Layers executed by the last recording
+
+    // Hash and render area of the RenderLists the layers were last built from. While both match, nothing is re-uploaded.
+    u64 contentHash{0};
+    VkRect2D contentArea{};
+    bool contentValid{false};
+
+    // Written by commandBuffer and the layers, read back after the next wait on renderFence.
+    QueryPool queries{};
+    bool queriesPending{false};
+    u64 queryPixels{0}; // Pixels rendered by the submission the queries belong to
+
+    // Latency of the last submission. presentObserved is set once it was seen presented, or completed without present wait.
+    std::chrono::steady_clock::time_point submitTime{};
+    u64 presentId{0};
+    bool presentObserved{true};
   };
   void createFence(const Instance &instance, VkFence &fenceOut);
   void createSemaphore(const Instance &instance, VkSemaphore &semaOut);
 
   // Image methods
   void createImage(const Instance &instance, Image &image);
+  // Clamped to the edge, no mipmaps.
+  void createSampler(const Instance &instance, VkFilter filter, VkSampler &samplerOut);
 
   void transitionImage(VkCommandBuffer &cmdBuffer, VkImage &image,
     VkPipelineStageFlags2 srcStage, VkAccessFlags2 srcAccessMask,
     VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccessMask,
-    VkImageLayout oldLayout, VkImageLayout newLayout);
+    VkImageLayout oldLayout, VkImageLayout newLayout, VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT);
 
   // Descriptor methods
   struct DescriptorPoolInfo {
@@ -175,8 +359,17 @@ namespace VkBackend {
   void allocDescriptorSets(const Instance &instance, const DescriptorSetAllocInfo &allocInfo, VkDescriptorSet &descSetOut);
 
   // Pipeline Methods
-  void createDynamicGraphicsPipeline(const Instance &instance, Shader &shader,
-    std::vector<VkDescriptorSetLayout> &layouts, VkPipeline &dynamicPipeline, VkPipelineLayout &pipelineLayout);
+  // Compiles one variant for dynamic rendering into COLOR_FORMAT with a DEPTH_FORMAT depth attachment. Returns false if the driver rejected it.
+  bool createDynamicGraphicsPipeline(const Instance &instance, const PipelineDesc &desc, VkPipelineLayout layout, VkPipeline &pipelineOut);
+
+  // Creates the layout shared by all variants, with the DefaultPushConstant range, and starts the compiler thread.
+  void setupPipelineRepository(Instance &instance, const std::vector<VkDescriptorSetLayout> &layouts);
+  // Stops the compiler thread, waiting for the variant it is on, and destroys every variant and the layout.
+  void destroyPipelineRepository(Instance &instance);
+  // Returns the variant for desc. A missing variant is queued for the compiler thread and, with allowFallback,
+  // a compatible variant that is already compiled is returned meanwhile, preferring one with the same shader.
+  // Waits for the compiler only if there is no such fallback. Returns null if the variant failed to compile.
+  VkPipeline getPipeline(Instance &instance, const PipelineDesc &desc, bool allowFallback = true);
 
   // Future compat wip - for devices that dont support dynamic rendering.
   struct RenderpassInfo {
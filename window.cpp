@@ -14,6 +14,11 @@ VKUIX::Window::Window(const char *windowTitle, const int width, const int height
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
     windowPtr = std::make_unique<GLFWwindow*>(glfwCreateWindow(width, height, windowTitle, nullptr, nullptr));
 
+    // The framebuffer differs from the window size with content scaling.
+    glfwGetFramebufferSize(*windowPtr, &this->width, &this->height);
+    glfwSetWindowUserPointer(*windowPtr, this);
+    glfwSetFramebufferSizeCallback(*windowPtr, onFramebufferSize);
+
 #ifdef _WIN32
     HWND hwnd = glfwGetWin32Window(*windowPtr);
     BOOL darkMode = TRUE;
@@ -24,6 +29,12 @@ VKUIX::Window::Window(const char *windowTitle, const int width, const int height
 }
 
 
+void VKUIX::Window::onFramebufferSize(GLFWwindow *glfwWindow, const int width, const int height) {
+  auto *window = static_cast<Window*>(glfwGetWindowUserPointer(glfwWindow));
+  window->width = width;
+  window->height = height;
+}
+
 void VKUIX::Window::show() const {
   glfwShowWindow(*windowPtr);
 }
@@ -20,6 +20,7 @@ namespace VKUIX {
     void show() const;
 
     [[nodiscard]] GLFWwindow* getWindowPtr() const;
+    // Framebuffer size in pixels, kept up to date while events are polled. Zero while the window is minimized.
     [[nodiscard]] VkExtent2D getExtent() const;
     [[nodiscard]] VkRect2D getRenderArea() const;
 
@@ -28,6 +29,8 @@ namespace VKUIX {
     int height;
 
     uptr<GLFWwindow*> windowPtr;
+
+    static void onFramebufferSize(GLFWwindow *glfwWindow, int width, int height);
   };
 
 }
\ No newline at end of file